@@ -5,13 +5,19 @@
  * Copyright (C) 2022-2023 NVIDIA CORPORATION.
  */
 
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include "psc_mailbox.h"
 
@@ -19,32 +25,74 @@
 #define PSC_MBOX_EXT_CTRL   0x4
 #define PSC_MBOX_PSC_CTRL   0x8
 #define PSC_MBOX_IN         0x800
-#define PSC_MBOX_MAP_SIZE   0x10000
-
-/** 16 IN/OUT parameters. IN: EXT -> PSC; OUT: PSC -> EXT. */
-#define MBOX_BUF_NWORDS             16U
 
 #define PSC_MAILBOX_TIMEOUT_USEC    1000000U
 
-/* MB5 (ARM NON-SECURE base address) */
-#define PSC_MBOX_EXT_CTRL_OFF       0x4U
-#define   PSC_MBOX_EXT_CTRL_IN_VALID_MASK      0x1U
-#define   PSC_MBOX_EXT_CTRL_OUT_DONE_MASK      0x10U
-#define PSC_MBOX_PSC_CTRL_OFF       0x8U
-#define   PSC_MBOX_PSC_CTRL_OUT_VALID_MASK     0x1U
-#define PSC_MBOX_IN_OFF             0x800U
-#define PSC_MBOX_OUT_OFF            0x1000U
+/*
+ * Max time to wait for the mailbox owner. An owner holds the lock for one
+ * request/response exchange, which is bounded by the Tx and Rx timeouts.
+ */
+#define PSC_MAILBOX_LOCK_TIMEOUT_USEC   (10U * PSC_MAILBOX_TIMEOUT_USEC)
+
+/* Shared memory object holding the mailbox lock (/dev/shm/psc_mailbox). */
+#define PSC_MBOX_SHM_NAME           "/psc_mailbox"
+#define PSC_MBOX_SHM_MAGIC          0x50534d43U
 
 void *psc_mbox_mmap;
 int psc_mbox_fd;
 
+/* Registers come from a simulated PSC, see psc_mailbox_init_window(). */
+static bool psc_mbox_window;
+
+/* Mailbox state shared by all threads and processes using this library. */
+typedef struct psc_mailbox_shared {
+    uint32_t magic;             /* set once the lock is initialized */
+    pid_t owner;                /* pid of the current owner, 0 if none */
+    pthread_mutex_t lock;       /* robust, process-shared mailbox lock */
+    pid_t flow_owner;           /* pid of the SPDM flow owner, 0 if none */
+    pthread_mutex_t flow;       /* robust, process-shared SPDM flow lock */
+} psc_mailbox_shared_t;
+
+static psc_mailbox_shared_t *psc_mbox_shared;
+
+/* Busy-poll budget per wait before falling back to sleep, 0 to disable. */
+static uint32_t psc_mbox_poll_usec;
+
 static inline uint64_t psc_mailbox_get_usec(void)
 {
-    struct timeval t;
+    struct timespec t;
 
-    gettimeofday(&t, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t);
 
-    return t.tv_sec * 1000000LL + t.tv_usec;
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+static inline void psc_mailbox_cpu_relax(void)
+{
+#if defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#elif defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __sync_synchronize();
+#endif
+}
+
+/*
+ * Wait for the mailbox registers to change. Spin while still within the
+ * busy-poll budget counted from the last progress, then sleep.
+ */
+static inline void psc_mailbox_idle(uint64_t now, uint64_t t_busy)
+{
+    if (now - t_busy < psc_mbox_poll_usec)
+        psc_mailbox_cpu_relax();
+    else
+        usleep(1000);
+}
+
+void psc_mailbox_set_poll_budget(uint32_t usec)
+{
+    psc_mbox_poll_usec = usec;
 }
 
 static inline void psc_mailbox_writel(uint32_t val, uint32_t offset)
@@ -71,10 +119,72 @@ static inline uint32_t psc_mailbox_readl(uint32_t offset)
     return val;
 }
 
+/*
+ * Map the shared mailbox lock, creating and initializing it if this is the
+ * first user. Creation is serialized with flock() so that concurrent first
+ * users can't initialize the mutex twice; the flock is dropped by the kernel
+ * if the creator dies half way, and the next user re-initializes it.
+ */
+static int psc_mailbox_shared_init(void)
+{
+    pthread_mutexattr_t attr;
+    psc_mailbox_shared_t *shared;
+    struct stat st;
+    int fd, rc = -1;
+
+    fd = shm_open(PSC_MBOX_SHM_NAME, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX) == -1) {
+        perror("flock");
+        goto out;
+    }
+
+    if (fstat(fd, &st) == -1 ||
+        (st.st_size < (off_t)sizeof(*shared) &&
+         ftruncate(fd, sizeof(*shared)) == -1)) {
+        perror("shm size");
+        goto out;
+    }
+
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fd, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        goto out;
+    }
+
+    if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) !=
+        PSC_MBOX_SHM_MAGIC) {
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&shared->lock, &attr);
+        pthread_mutex_init(&shared->flow, &attr);
+        pthread_mutexattr_destroy(&attr);
+        shared->owner = 0;
+        shared->flow_owner = 0;
+        __atomic_store_n(&shared->magic, PSC_MBOX_SHM_MAGIC, __ATOMIC_RELEASE);
+    }
+
+    psc_mbox_shared = shared;
+    rc = 0;
+
+out:
+    close(fd);
+    return rc;
+}
+
 int psc_mailbox_init(void)
 {
     int fd;
 
+    if (psc_mailbox_shared_init())
+        return -1;
+
     fd = open("/dev/mem", O_RDWR | O_SYNC);
     if (fd != -1) {
         psc_mbox_mmap = (unsigned long *)mmap(NULL, PSC_MBOX_MAP_SIZE,
@@ -99,10 +209,47 @@ int psc_mailbox_init(void)
     return 0;
 }
 
+int psc_mailbox_init_window(const char *path)
+{
+    int fd;
+
+    if (psc_mailbox_shared_init())
+        return -1;
+
+    fd = open(path, O_RDWR);
+    if (fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    psc_mbox_mmap = mmap(NULL, PSC_MBOX_MAP_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    close(fd);
+    if (psc_mbox_mmap == MAP_FAILED) {
+        perror("mmap");
+        psc_mbox_mmap = NULL;
+        return -1;
+    }
+    psc_mbox_window = true;
+
+    return 0;
+}
+
 /* Mark it done receiving the message from PSC. */
 static inline void psc_mailbox_out_done(void)
 {
-    uint32_t ext_ctrl;
+    uint32_t ext_ctrl, psc_ctrl;
+
+    /*
+     * The hardware drops OUT_VALID as OUT_DONE is set. A simulated PSC
+     * can't do it in the same step, so clear it first here, or the next
+     * poll would see the segment that was just read.
+     */
+    if (psc_mbox_window) {
+        psc_ctrl = psc_mailbox_readl(PSC_MBOX_PSC_CTRL_OFF);
+        psc_ctrl &= ~PSC_MBOX_PSC_CTRL_OUT_VALID_MASK;
+        psc_mailbox_writel(psc_ctrl, PSC_MBOX_PSC_CTRL_OFF);
+    }
 
     ext_ctrl = psc_mailbox_readl(PSC_MBOX_EXT_CTRL_OFF);
     ext_ctrl |= PSC_MBOX_EXT_CTRL_OUT_DONE_MASK;
@@ -119,6 +266,110 @@ static inline bool psc_mailbox_out_valid(void)
     return (psc_ctrl & PSC_MBOX_PSC_CTRL_OUT_VALID_MASK) ? true : false;
 }
 
+/*
+ * Bring the mailbox back to idle after its previous owner died in the middle
+ * of an exchange. PSC may still be working on a request from the dead owner,
+ * so keep acknowledging its response segments for one full Rx timeout. A
+ * partially sent request is dropped by PSC once the next request restarts
+ * at offset 0.
+ */
+static void psc_mailbox_recover(void)
+{
+    uint64_t t0 = psc_mailbox_get_usec();
+    uint32_t dropped = 0;
+
+    while (psc_mailbox_get_usec() - t0 <= PSC_MAILBOX_TIMEOUT_USEC) {
+        if (psc_mailbox_out_valid()) {
+            psc_mailbox_out_done();
+            dropped++;
+            continue;
+        }
+        usleep(1000);
+    }
+
+    if (dropped)
+        printf("dropped %u stale segments\n", dropped);
+}
+
+/* Lock a shared mutex, waiting up to 'usec'. Returns the pthread status. */
+static int psc_mailbox_timedlock(pthread_mutex_t *mutex, uint64_t usec)
+{
+    uint64_t deadline;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    deadline = ts.tv_nsec / 1000U + usec;
+    ts.tv_sec += deadline / 1000000U;
+    ts.tv_nsec = (deadline % 1000000U) * 1000U;
+
+    return pthread_mutex_timedlock(mutex, &ts);
+}
+
+int psc_mailbox_lock(void)
+{
+    int rc;
+
+    if (!psc_mbox_shared)
+        return -EINVAL;
+
+    rc = psc_mailbox_timedlock(&psc_mbox_shared->lock,
+                               PSC_MAILBOX_LOCK_TIMEOUT_USEC);
+    if (rc == EOWNERDEAD) {
+        printf("mailbox owner %d died, recovering\n", psc_mbox_shared->owner);
+        psc_mailbox_recover();
+        pthread_mutex_consistent(&psc_mbox_shared->lock);
+        rc = 0;
+    }
+    if (rc) {
+        printf("mailbox lock failed - %s (owner %d)\n", strerror(rc),
+               psc_mbox_shared->owner);
+        return -rc;
+    }
+
+    psc_mbox_shared->owner = getpid();
+
+    return 0;
+}
+
+void psc_mailbox_unlock(void)
+{
+    psc_mbox_shared->owner = 0;
+    pthread_mutex_unlock(&psc_mbox_shared->lock);
+}
+
+int psc_mailbox_flow_lock(uint32_t timeout_ms)
+{
+    int rc;
+
+    if (!psc_mbox_shared)
+        return -EINVAL;
+
+    rc = psc_mailbox_timedlock(&psc_mbox_shared->flow,
+                               (uint64_t)timeout_ms * 1000U);
+    if (rc == EOWNERDEAD) {
+        /* The next GET_VERSION resets what the dead owner left. */
+        printf("SPDM flow owner %d died, taking over\n",
+               psc_mbox_shared->flow_owner);
+        pthread_mutex_consistent(&psc_mbox_shared->flow);
+        rc = 0;
+    }
+    if (rc) {
+        printf("SPDM flow lock failed - %s (owner %d)\n", strerror(rc),
+               psc_mbox_shared->flow_owner);
+        return -rc;
+    }
+
+    psc_mbox_shared->flow_owner = getpid();
+
+    return 0;
+}
+
+void psc_mailbox_flow_unlock(void)
+{
+    psc_mbox_shared->flow_owner = 0;
+    pthread_mutex_unlock(&psc_mbox_shared->flow);
+}
+
 /*
  * Send mailbox message
  *
@@ -132,7 +383,7 @@ bool psc_mailbox_send_msg(uint32_t opcode, uint16_t context_id,
     bool status = false;
 
     if ((NULL != buf) && (len > 0U)) {
-        uint64_t t0 = psc_mailbox_get_usec(), t1;
+        uint64_t t0 = psc_mailbox_get_usec(), t1, t_busy = t0;
         uint32_t i, ext_ctrl, remaining = len, cur_len, data;
 
         /* Try to send all data in a loop. */
@@ -151,7 +402,7 @@ bool psc_mailbox_send_msg(uint32_t opcode, uint16_t context_id,
              */
             ext_ctrl = psc_mailbox_readl(PSC_MBOX_EXT_CTRL_OFF);
             if (ext_ctrl & PSC_MBOX_EXT_CTRL_IN_VALID_MASK) {
-                usleep(1000);
+                psc_mailbox_idle(t1, t_busy);
                 continue;
             }
 
@@ -190,6 +441,7 @@ bool psc_mailbox_send_msg(uint32_t opcode, uint16_t context_id,
             }
 
             remaining -= cur_len;
+            t_busy = t1;
 
             /* This is for Linux. */
             if (psc_mbox_mmap) {
@@ -231,7 +483,7 @@ bool psc_mailbox_recv_msg(uint32_t opcode, uint16_t *context_id,
 
     if ((NULL != buf) && (len != NULL) && (*len > 0U)) {
         uint32_t i, data, offset = 0U;
-        uint64_t t0 = psc_mailbox_get_usec(), t1;
+        uint64_t t0 = psc_mailbox_get_usec(), t1, t_busy = t0;
 
         *context_id = 0xFFFF;
 
@@ -247,7 +499,7 @@ bool psc_mailbox_recv_msg(uint32_t opcode, uint16_t *context_id,
 
             /* Check data availablity. */
             if (!psc_mailbox_out_valid()) {
-                usleep(1000);
+                psc_mailbox_idle(t1, t_busy);
                 continue;
             }
 
@@ -319,6 +571,7 @@ bool psc_mailbox_recv_msg(uint32_t opcode, uint16_t *context_id,
             }
 
             offset += hdr.cur_len;
+            t_busy = t1;
 
             /* Finished this segment. */
             psc_mailbox_out_done();
@@ -333,3 +586,33 @@ bool psc_mailbox_recv_msg(uint32_t opcode, uint16_t *context_id,
 
     return status;
 }
+
+/*
+ * Mailbox request/response exchange
+ *
+ * This API sends one message and receives its response while owning the
+ * mailbox, so that exchanges from different threads or processes never
+ * interleave on the IN/OUT registers.
+ */
+bool psc_mailbox_xfer(uint32_t opcode, uint16_t *context_id,
+                      const uint8_t *req, uint32_t req_len,
+                      uint8_t *rsp, uint32_t *rsp_len)
+{
+    bool status;
+
+    if (psc_mailbox_lock())
+        return false;
+
+    status = psc_mailbox_send_msg(opcode, *context_id, req, req_len);
+    if (!status) {
+        printf("psc_mailbox_send_msg failed\n");
+    } else {
+        status = psc_mailbox_recv_msg(opcode, context_id, rsp, rsp_len);
+        if (!status)
+            printf("psc_mailbox_recv_msg failed\n");
+    }
+
+    psc_mailbox_unlock();
+
+    return status;
+}
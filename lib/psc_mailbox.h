@@ -11,6 +11,21 @@
 /* Mailbox message opcode for SPDM. */
 #define PSC_MBOX_SPDM_OPCODE     0x5350444dU
 
+/* Register window, also served by the simulated PSC (psc_sim.h). */
+#define PSC_MBOX_MAP_SIZE   0x10000
+
+/** 16 IN/OUT parameters. IN: EXT -> PSC; OUT: PSC -> EXT. */
+#define MBOX_BUF_NWORDS             16U
+
+/* MB5 (ARM NON-SECURE base address) */
+#define PSC_MBOX_EXT_CTRL_OFF       0x4U
+#define   PSC_MBOX_EXT_CTRL_IN_VALID_MASK      0x1U
+#define   PSC_MBOX_EXT_CTRL_OUT_DONE_MASK      0x10U
+#define PSC_MBOX_PSC_CTRL_OFF       0x8U
+#define   PSC_MBOX_PSC_CTRL_OUT_VALID_MASK     0x1U
+#define PSC_MBOX_IN_OFF             0x800U
+#define PSC_MBOX_OUT_OFF            0x1000U
+
 /**
  * Segment header when splitting large message into multiple segments and
  * send each of them over mailbox.
@@ -30,6 +45,61 @@ typedef union psc_mailbox_seg_hdr {
 /* Initialize mailbox transport. */
 int psc_mailbox_init(void);
 
+/*
+ * Initialize mailbox transport on a register window file
+ *
+ * Same as psc_mailbox_init(), but the registers are the first
+ * PSC_MBOX_MAP_SIZE bytes of 'path', as served by a simulated PSC.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int psc_mailbox_init_window(const char *path);
+
+/*
+ * Set the busy-poll budget
+ *
+ * While waiting for PSC, spin on the mailbox registers for up to 'usec'
+ * microseconds after the last progress before falling back to 1ms sleeps.
+ * The default is 0 (always sleep).
+ */
+void psc_mailbox_set_poll_budget(uint32_t usec);
+
+/*
+ * Acquire / release mailbox ownership
+ *
+ * The mailbox has a single set of IN/OUT registers, so a request and its
+ * response must not interleave with messages from other users. The lock is
+ * a robust mutex in shared memory, shared by all threads and processes
+ * using this library. If the owner dies while holding it, the next caller
+ * drains the stale exchange and takes over.
+ *
+ * psc_mailbox_lock() returns 0 on success or a negative errno value.
+ */
+int psc_mailbox_lock(void);
+void psc_mailbox_unlock(void);
+
+/* Suggested wait for psc_mailbox_flow_lock(). */
+#define PSC_MAILBOX_FLOW_TIMEOUT_MSEC   30000U
+
+/*
+ * Acquire / release the SPDM flow
+ *
+ * The mailbox lock only keeps exchanges whole. The PSC holds one SPDM
+ * connection state (VCA and L1 transcript) for all users of context id 0,
+ * so a GET_VERSION from one user resets the flow of another one, and its
+ * signed MEASUREMENTS no longer match the transcript it kept. A requester
+ * must hold the flow from GET_VERSION through its last signed
+ * MEASUREMENTS; spdm-proxy holds it for each client connection, as it
+ * can't tell where a relayed flow ends, and drops idle clients. Users
+ * that don't take it, such as older builds of the tools, can still break
+ * other flows.
+ *
+ * psc_mailbox_flow_lock() waits up to 'timeout_ms' and returns 0 on success
+ * or a negative errno value. A flow left by a dead owner is taken over.
+ */
+int psc_mailbox_flow_lock(uint32_t timeout_ms);
+void psc_mailbox_flow_unlock(void);
+
 /*
  * Send mailbox message
  *
@@ -60,4 +130,23 @@ bool psc_mailbox_send_msg(uint32_t opcode, uint16_t context_id,
 bool psc_mailbox_recv_msg(uint32_t opcode, uint16_t *context_id,
                           uint8_t *buf, uint32_t *len);
 
+/*
+ * Send mailbox message and receive the response
+ *
+ * This API takes the mailbox lock for one request/response exchange. It's
+ * the preferred API; psc_mailbox_send_msg() and psc_mailbox_recv_msg() must
+ * be called with the lock held.
+ *
+ * opcode: mailbox opcode
+ * context_id: spdm session identifier, updated from the response
+ * req: request buffer pointer
+ * req_len: request length
+ * rsp: response buffer pointer
+ * rsp_len: response buffer length as input, response length as output
+ *
+ */
+bool psc_mailbox_xfer(uint32_t opcode, uint16_t *context_id,
+                      const uint8_t *req, uint32_t req_len,
+                      uint8_t *rsp, uint32_t *rsp_len);
+
 #endif /* _PSC_MAILBOX_H_ */
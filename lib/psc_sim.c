@@ -0,0 +1,420 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* Simulated PSC.
+ *
+ * Plays the PSC side of the mailbox on a register window in a shared file,
+ * so spdm-proxy and the native requester can run on any Linux host with
+ * psc_mailbox_init_window(). Segments go through the same IN/OUT registers
+ * and handshake bits as on the hardware; the SPDM responder behind them
+ * only produces responses of realistic size, after a configurable service
+ * time.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "psc_mailbox.h"
+#include "psc_sim.h"
+#include "spdm_proto.h"
+#include "spdm_req.h"
+
+/* Measurement blocks: DMTF format, SHA-512 digests. */
+#define PSC_SIM_MEAS_DIGEST_SIZE    64U
+#define PSC_SIM_MEAS_BLOCK_SIZE     (4U + 3U + PSC_SIM_MEAS_DIGEST_SIZE)
+#define PSC_SIM_MAX_MEAS            32U
+#define PSC_SIM_MAX_CHAIN_SIZE      0x8000U
+#define PSC_SIM_SIGNATURE_SIZE      96U     /* ECDSA P-384 */
+
+/* Max wait for the requester to take a response segment. */
+#define PSC_SIM_TIMEOUT_USEC        1000000U
+
+/* Spin on the registers this long after the last message, then sleep. */
+#define PSC_SIM_SPIN_USEC           100000U
+#define PSC_SIM_IDLE_USEC           100U
+
+#define PSC_SIM_SEG_SIZE            ((MBOX_BUF_NWORDS - 2U) * 4U)
+
+static uint32_t *psc_sim_regs;
+
+static inline uint64_t psc_sim_get_usec(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+static inline uint32_t psc_sim_readl(uint32_t offset)
+{
+    return __atomic_load_n(&psc_sim_regs[offset / 4U], __ATOMIC_SEQ_CST);
+}
+
+static inline void psc_sim_writel(uint32_t val, uint32_t offset)
+{
+    __atomic_store_n(&psc_sim_regs[offset / 4U], val, __ATOMIC_SEQ_CST);
+}
+
+static inline void psc_sim_set(uint32_t mask, uint32_t offset)
+{
+    __atomic_fetch_or(&psc_sim_regs[offset / 4U], mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void psc_sim_clear(uint32_t mask, uint32_t offset)
+{
+    __atomic_fetch_and(&psc_sim_regs[offset / 4U], ~mask, __ATOMIC_SEQ_CST);
+}
+
+static inline void psc_sim_put16(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = val >> 8;
+}
+
+static inline void psc_sim_put32(uint8_t *p, uint32_t val)
+{
+    psc_sim_put16(p, val & 0xFFFF);
+    psc_sim_put16(p + 2, val >> 16);
+}
+
+static inline uint16_t psc_sim_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+/*
+ * Wait for a register bit to be set, until stopped or the timeout (0 for
+ * none). 'idle' is when the last message was seen, for the spin budget.
+ */
+static bool psc_sim_wait(uint32_t offset, uint32_t mask, uint64_t idle,
+                         uint32_t timeout_usec,
+                         const volatile sig_atomic_t *stop)
+{
+    uint64_t t0 = psc_sim_get_usec(), t;
+
+    while (!(psc_sim_readl(offset) & mask)) {
+        if (*stop) {
+            return false;
+        }
+
+        t = psc_sim_get_usec();
+        if (timeout_usec && t - t0 > timeout_usec) {
+            return false;
+        }
+
+        /* Yield while spinning, the requester may share the CPU. */
+        if (t - idle < PSC_SIM_SPIN_USEC) {
+            sched_yield();
+        } else {
+            usleep(PSC_SIM_IDLE_USEC);
+        }
+    }
+
+    return true;
+}
+
+static uint32_t psc_sim_error(uint8_t *rsp, uint8_t code, uint8_t data)
+{
+    rsp[1] = SPDM_ERROR;
+    rsp[2] = code;
+    rsp[3] = data;
+
+    return SPDM_HDR_SIZE;
+}
+
+static uint32_t psc_sim_measurements(const psc_sim_t *sim, const uint8_t *req,
+                                     uint8_t *rsp)
+{
+    uint8_t op = req[3], first, last, i;
+    uint32_t n = 8U;
+    uint8_t *blk;
+
+    rsp[1] = SPDM_MEASUREMENTS;
+    if (op == SPDM_MEAS_OP_COUNT) {
+        rsp[2] = sim->num_meas;
+        first = 1;
+        last = 0;
+    } else if (op == SPDM_MEAS_OP_ALL) {
+        first = 1;
+        last = sim->num_meas;
+    } else if (op <= sim->num_meas) {
+        first = op;
+        last = op;
+    } else {
+        return psc_sim_error(rsp, SPDM_ERROR_INVALID_REQUEST, 0);
+    }
+
+    for (i = first; i <= last; i++) {
+        blk = rsp + n;
+        blk[0] = i;
+        blk[1] = 0x01;          /* DMTF measurement specification */
+        psc_sim_put16(blk + 2, 3U + PSC_SIM_MEAS_DIGEST_SIZE);
+        blk[4] = 0x01;          /* mutable firmware, digest */
+        psc_sim_put16(blk + 5, PSC_SIM_MEAS_DIGEST_SIZE);
+        memset(blk + 7, i, PSC_SIM_MEAS_DIGEST_SIZE);
+        n += PSC_SIM_MEAS_BLOCK_SIZE;
+    }
+    rsp[4] = op == SPDM_MEAS_OP_COUNT ? 0 : last - first + 1;
+    rsp[5] = (n - 8U) & 0xFF;
+    rsp[6] = ((n - 8U) >> 8) & 0xFF;
+    rsp[7] = (n - 8U) >> 16;
+
+    /* Nonce and no opaque data. */
+    memset(rsp + n, 0x5A, SPDM_NONCE_SIZE);
+    n += SPDM_NONCE_SIZE;
+    psc_sim_put16(rsp + n, 0);
+    n += 2U;
+
+    if (req[2] & SPDM_MEAS_ATTR_SIGNATURE) {
+        memset(rsp + n, 0, PSC_SIM_SIGNATURE_SIZE);
+        n += PSC_SIM_SIGNATURE_SIZE;
+    }
+
+    return n;
+}
+
+/* Build the response to one SPDM request. Returns its length. */
+static uint32_t psc_sim_respond(const psc_sim_t *sim, const uint8_t *msg,
+                                uint32_t len, uint8_t *out)
+{
+    const uint8_t *req = msg + 1;
+    uint8_t *rsp = out + 1;
+    uint32_t n, offset, portion;
+
+    out[0] = MCTP_MSG_TYPE_SPDM;
+    memset(rsp, 0, SPDM_HDR_SIZE);
+    if (len < 1U + SPDM_HDR_SIZE || msg[0] != MCTP_MSG_TYPE_SPDM) {
+        rsp[0] = SPDM_VERSION_10;
+        return 1U + psc_sim_error(rsp, SPDM_ERROR_INVALID_REQUEST, 0);
+    }
+    len--;
+    rsp[0] = req[0];
+
+    switch (req[1]) {
+    case SPDM_GET_VERSION:
+        rsp[0] = SPDM_VERSION_10;
+        rsp[1] = SPDM_VERSION;
+        rsp[4] = 0;
+        rsp[5] = 2;
+        psc_sim_put16(rsp + 6, SPDM_VERSION_11 << 8);
+        psc_sim_put16(rsp + 8, SPDM_VERSION_12 << 8);
+        n = 10U;
+        break;
+
+    case SPDM_GET_CAPABILITIES:
+        n = req[0] >= SPDM_VERSION_12 ? 20U : 12U;
+        memset(rsp + SPDM_HDR_SIZE, 0, n - SPDM_HDR_SIZE);
+        rsp[1] = SPDM_CAPABILITIES;
+        psc_sim_put32(rsp + 8, SPDM_CAP_CERT_CAP | SPDM_CAP_MEAS_CAP_SIG);
+        if (n == 20U) {
+            psc_sim_put32(rsp + 12, SPDM_REQ_MAX_MSG_SIZE - 1U);
+            psc_sim_put32(rsp + 16, SPDM_REQ_MAX_MSG_SIZE - 1U);
+        }
+        break;
+
+    case SPDM_NEGOTIATE_ALGORITHMS:
+        n = 36U;
+        memset(rsp + SPDM_HDR_SIZE, 0, n - SPDM_HDR_SIZE);
+        rsp[1] = SPDM_ALGORITHMS;
+        psc_sim_put16(rsp + 4, n);
+        rsp[6] = 0x01;          /* DMTF measurement specification */
+        psc_sim_put32(rsp + 8, SPDM_MEAS_HASH_SHA_512);
+        psc_sim_put32(rsp + 12, SPDM_ASYM_ECDSA_P384);
+        psc_sim_put32(rsp + 16, SPDM_HASH_SHA_384);
+        break;
+
+    case SPDM_GET_CERTIFICATE:
+        offset = len >= 8U ? psc_sim_get16(req + 4) : sim->chain_size;
+        if (offset >= sim->chain_size) {
+            n = psc_sim_error(rsp, SPDM_ERROR_INVALID_REQUEST, 0);
+            break;
+        }
+        portion = psc_sim_get16(req + 6);
+        if (portion > sim->chain_size - offset) {
+            portion = sim->chain_size - offset;
+        }
+        if (portion > SPDM_REQ_MAX_MSG_SIZE - 1U - 8U) {
+            portion = SPDM_REQ_MAX_MSG_SIZE - 1U - 8U;
+        }
+        rsp[1] = SPDM_CERTIFICATE;
+        rsp[2] = req[2] & 0xF;
+        psc_sim_put16(rsp + 4, portion);
+        psc_sim_put16(rsp + 6, sim->chain_size - offset - portion);
+        memset(rsp + 8, 0x30, portion);
+        n = 8U + portion;
+        break;
+
+    case SPDM_GET_MEASUREMENTS:
+        n = psc_sim_measurements(sim, req, rsp);
+        break;
+
+    default:
+        n = psc_sim_error(rsp, SPDM_ERROR_UNSUPPORTED_REQUEST, req[1]);
+        break;
+    }
+
+    return 1U + n;
+}
+
+/* Post a response in segments, each taken by the requester with OUT_DONE. */
+static bool psc_sim_send(uint32_t opcode, uint8_t ctx_id, const uint8_t *buf,
+                         uint32_t len, const volatile sig_atomic_t *stop)
+{
+    psc_mailbox_seg_hdr_t hdr;
+    uint32_t offset, cur_len, i, data;
+
+    for (offset = 0; offset < len; offset += cur_len) {
+        cur_len = len - offset > PSC_SIM_SEG_SIZE ? PSC_SIM_SEG_SIZE :
+            len - offset;
+
+        hdr.words[1] = 0;
+        hdr.ctx_id = ctx_id;
+        hdr.cur_len = cur_len;
+        hdr.offset = offset;
+        hdr.more = offset + cur_len < len;
+        psc_sim_writel(opcode, PSC_MBOX_OUT_OFF);
+        psc_sim_writel(hdr.words[1], PSC_MBOX_OUT_OFF + 4U);
+        for (i = 0; i < cur_len; i += 4U) {
+            data = 0;
+            memcpy(&data, buf + offset + i, cur_len - i < 4U ? cur_len - i :
+                   4U);
+            psc_sim_writel(data, PSC_MBOX_OUT_OFF + 8U + i);
+        }
+
+        psc_sim_set(PSC_MBOX_PSC_CTRL_OUT_VALID_MASK, PSC_MBOX_PSC_CTRL_OFF);
+        if (!psc_sim_wait(PSC_MBOX_EXT_CTRL_OFF,
+                          PSC_MBOX_EXT_CTRL_OUT_DONE_MASK,
+                          psc_sim_get_usec(), PSC_SIM_TIMEOUT_USEC, stop)) {
+            psc_sim_clear(PSC_MBOX_PSC_CTRL_OUT_VALID_MASK,
+                          PSC_MBOX_PSC_CTRL_OFF);
+            return false;
+        }
+        psc_sim_clear(PSC_MBOX_PSC_CTRL_OUT_VALID_MASK, PSC_MBOX_PSC_CTRL_OFF);
+        psc_sim_clear(PSC_MBOX_EXT_CTRL_OUT_DONE_MASK, PSC_MBOX_EXT_CTRL_OFF);
+    }
+
+    return true;
+}
+
+static int psc_sim_map(const char *path)
+{
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        printf("%s: %m\n", path);
+        return -1;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        printf("%s: already served\n", path);
+        close(fd);
+        return -1;
+    }
+
+    if (ftruncate(fd, PSC_MBOX_MAP_SIZE)) {
+        printf("%s: %m\n", path);
+        close(fd);
+        return -1;
+    }
+
+    psc_sim_regs = mmap(NULL, PSC_MBOX_MAP_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (psc_sim_regs == MAP_FAILED) {
+        printf("mmap failed - %m\n");
+        psc_sim_regs = NULL;
+        close(fd);
+        return -1;
+    }
+    memset(psc_sim_regs, 0, PSC_MBOX_MAP_SIZE);
+
+    /* Keep the lock for as long as the process runs. */
+    return fd;
+}
+
+int psc_sim_run(psc_sim_t *sim, const char *path,
+                const volatile sig_atomic_t *stop)
+{
+    static uint8_t req[SPDM_REQ_MAX_MSG_SIZE], rsp[SPDM_REQ_MAX_MSG_SIZE];
+    psc_mailbox_seg_hdr_t hdr;
+    uint32_t len = 0, rsp_len, i, data;
+    uint64_t idle;
+    int fd;
+
+    if (sim->num_meas > PSC_SIM_MAX_MEAS) {
+        sim->num_meas = PSC_SIM_MAX_MEAS;
+    }
+    if (sim->chain_size > PSC_SIM_MAX_CHAIN_SIZE) {
+        sim->chain_size = PSC_SIM_MAX_CHAIN_SIZE;
+    }
+
+    fd = psc_sim_map(path);
+    if (fd == -1) {
+        return -1;
+    }
+
+    idle = psc_sim_get_usec();
+    while (psc_sim_wait(PSC_MBOX_EXT_CTRL_OFF,
+                        PSC_MBOX_EXT_CTRL_IN_VALID_MASK, idle, 0, stop)) {
+        hdr.words[0] = psc_sim_readl(PSC_MBOX_IN_OFF);
+        hdr.words[1] = psc_sim_readl(PSC_MBOX_IN_OFF + 4U);
+
+        /* Offset 0 starts a new message, drop any partial one. */
+        if (!hdr.offset) {
+            len = 0;
+        }
+        if (hdr.offset != len || !hdr.cur_len ||
+            hdr.cur_len > PSC_SIM_SEG_SIZE ||
+            len + hdr.cur_len > sizeof(req)) {
+            sim->errors++;
+            len = 0;
+            psc_sim_clear(PSC_MBOX_EXT_CTRL_IN_VALID_MASK,
+                          PSC_MBOX_EXT_CTRL_OFF);
+            continue;
+        }
+
+        for (i = 0; i < hdr.cur_len; i += 4U) {
+            data = psc_sim_readl(PSC_MBOX_IN_OFF + 8U + i);
+            memcpy(req + len + i, &data, hdr.cur_len - i < 4U ?
+                   hdr.cur_len - i : 4U);
+        }
+        len += hdr.cur_len;
+
+        /* Segment consumed, the requester may post the next one. */
+        psc_sim_clear(PSC_MBOX_EXT_CTRL_IN_VALID_MASK, PSC_MBOX_EXT_CTRL_OFF);
+        if (hdr.more) {
+            continue;
+        }
+
+        rsp_len = psc_sim_respond(sim, req, len, rsp);
+        if (sim->delay_usec) {
+            usleep(sim->delay_usec);
+        }
+        if (sim->sign_usec && len > 3U && req[2] == SPDM_GET_MEASUREMENTS &&
+            (req[3] & SPDM_MEAS_ATTR_SIGNATURE)) {
+            usleep(sim->sign_usec);
+        }
+
+        if (!psc_sim_send(hdr.opcode, hdr.ctx_id, rsp, rsp_len, stop)) {
+            sim->errors++;
+        }
+        sim->messages++;
+        len = 0;
+        idle = psc_sim_get_usec();
+    }
+
+    munmap(psc_sim_regs, PSC_MBOX_MAP_SIZE);
+    psc_sim_regs = NULL;
+    close(fd);
+
+    return 0;
+}
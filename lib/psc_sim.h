@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* Simulated PSC header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _PSC_SIM_H_
+#define _PSC_SIM_H_
+
+#include <signal.h>
+#include <stdint.h>
+
+/* Default register window, for psc_mailbox_init_window(). */
+#define PSC_SIM_WINDOW_PATH     "/dev/shm/psc_sim_window"
+
+/* Simulated responder settings and counters. */
+typedef struct psc_sim {
+    uint32_t delay_usec;        /* service time of every message */
+    uint32_t sign_usec;         /* extra time of signed measurements */
+    uint32_t chain_size;        /* certificate chain size */
+    uint8_t num_meas;           /* number of measurement blocks */
+
+    uint64_t messages;          /* messages answered */
+    uint64_t errors;            /* dropped segments and timeouts */
+} psc_sim_t;
+
+/*
+ * Serve the PSC side of a mailbox register window
+ *
+ * Creates the window file if needed and answers SPDM requests posted
+ * through it, as psc_mailbox_xfer() does them, until 'stop' is set. Only
+ * the protocol and message sizes are simulated: the certificate chain,
+ * measurements and signatures are dummy data.
+ *
+ * Returns 0 when stopped or -1 if the window can't be set up.
+ */
+int psc_sim_run(psc_sim_t *sim, const char *path,
+                const volatile sig_atomic_t *stop);
+
+#endif /* _PSC_SIM_H_ */
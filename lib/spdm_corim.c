@@ -0,0 +1,944 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* CoRIM / CoMID reference value matcher.
+ *
+ * Only the parts of CoRIM (draft-ietf-rats-corim) needed to pull reference
+ * values out are decoded; everything else is skipped:
+ *
+ *   COSE_Sign1 #6.18([protected, unprotected, payload, signature])
+ *   corim-map #6.501({1: [+ #6.506(bytes .cbor concise-mid-tag)],
+ *                     ? 4: validity-map {? 0: not-before, 1: not-after}})
+ *   concise-mid-tag {4: triples-map {0: [+ [environment, [+ measurement]]]}}
+ *   environment-map {? 0: class-map {? 1: vendor, ? 2: model}, ...}
+ *   measurement-map {0: mkey (uint index), 1: measurement-values-map}
+ *   measurement-values-map {1: svn, 2: [+ [alg, digest]], 4: raw-value}
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spdm_corim.h"
+
+/* CBOR major types. */
+#define CBOR_UINT           0U
+#define CBOR_NINT           1U
+#define CBOR_BSTR           2U
+#define CBOR_TSTR           3U
+#define CBOR_ARRAY          4U
+#define CBOR_MAP            5U
+#define CBOR_TAG            6U
+#define CBOR_SIMPLE         7U
+
+#define CBOR_INDEFINITE     UINT64_MAX
+#define CBOR_BREAK          0xFFU
+#define CBOR_MAX_DEPTH      32
+
+/* CBOR tags. */
+#define TAG_EPOCH_TIME      1U
+#define TAG_COSE_SIGN1      18U
+#define TAG_CORIM           501U
+#define TAG_COMID           506U
+#define TAG_SVN             552U
+#define TAG_MIN_SVN         553U
+#define TAG_RAW_BYTES       560U
+
+/* corim-map keys. */
+#define CORIM_ID                0U
+#define CORIM_TAGS              1U
+#define CORIM_DEPENDENT_RIMS    2U
+#define CORIM_PROFILE           3U
+#define CORIM_RIM_VALIDITY      4U
+#define CORIM_ENTITIES          5U
+#define VALIDITY_NOT_BEFORE     0U
+#define VALIDITY_NOT_AFTER      1U
+
+/* concise-mid-tag keys. */
+#define COMID_TRIPLES           4U
+#define TRIPLES_REFERENCE       0U
+#define ENV_CLASS               0U
+#define CLASS_VENDOR            1U
+#define CLASS_MODEL             2U
+#define MEAS_MKEY               0U
+#define MEAS_MVAL               1U
+#define MVAL_SVN                1U
+#define MVAL_DIGESTS            2U
+#define MVAL_RAW_VALUE          4U
+
+typedef struct cbor {
+    const uint8_t *p;
+    const uint8_t *end;
+} cbor_t;
+
+/*
+ * Decode an item head. For strings, arrays and maps 'val' is the length,
+ * CBOR_INDEFINITE for indefinite lengths.
+ */
+static int cbor_head(cbor_t *c, uint8_t *major, uint64_t *val)
+{
+    uint8_t info, n, i;
+
+    if (c->p >= c->end) {
+        return -1;
+    }
+
+    *major = *c->p >> 5;
+    info = *c->p++ & 0x1F;
+
+    if (info < 24) {
+        *val = info;
+        return 0;
+    }
+    if (info == 31 && *major >= CBOR_BSTR && *major <= CBOR_MAP) {
+        *val = CBOR_INDEFINITE;
+        return 0;
+    }
+    if (info > 27) {
+        return -1;
+    }
+
+    n = 1U << (info - 24);
+    if (c->end - c->p < n) {
+        return -1;
+    }
+    for (*val = 0, i = 0; i < n; i++) {
+        *val = (*val << 8) | *c->p++;
+    }
+
+    return 0;
+}
+
+static bool cbor_at_break(cbor_t *c)
+{
+    if (c->p < c->end && *c->p == CBOR_BREAK) {
+        c->p++;
+        return true;
+    }
+
+    return false;
+}
+
+static int cbor_skip_depth(cbor_t *c, int depth)
+{
+    uint64_t val, i;
+    uint8_t major;
+
+    if (depth > CBOR_MAX_DEPTH || cbor_head(c, &major, &val)) {
+        return -1;
+    }
+
+    switch (major) {
+    case CBOR_BSTR:
+    case CBOR_TSTR:
+        if (val == CBOR_INDEFINITE) {
+            while (!cbor_at_break(c)) {
+                if (cbor_skip_depth(c, depth + 1)) {
+                    return -1;
+                }
+            }
+        } else if ((uint64_t)(c->end - c->p) < val) {
+            return -1;
+        } else {
+            c->p += val;
+        }
+        return 0;
+
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+        for (i = 0; val == CBOR_INDEFINITE || i < val; i++) {
+            if (val == CBOR_INDEFINITE && cbor_at_break(c)) {
+                break;
+            }
+            if (cbor_skip_depth(c, depth + 1) ||
+                (major == CBOR_MAP && cbor_skip_depth(c, depth + 1))) {
+                return -1;
+            }
+        }
+        return 0;
+
+    case CBOR_TAG:
+        return cbor_skip_depth(c, depth + 1);
+
+    default:
+        return 0;
+    }
+}
+
+static int cbor_skip(cbor_t *c)
+{
+    return cbor_skip_depth(c, 0);
+}
+
+/* Read an item head of the expected major type. */
+static int cbor_expect(cbor_t *c, uint8_t major, uint64_t *val)
+{
+    uint8_t m;
+
+    if (cbor_head(c, &m, val) || m != major) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Skip tags, returning the innermost one (0 if none). */
+static uint64_t cbor_untag(cbor_t *c)
+{
+    uint64_t tag = 0, val;
+    cbor_t t = *c;
+    uint8_t major;
+
+    while (!cbor_head(&t, &major, &val) && major == CBOR_TAG) {
+        tag = val;
+        *c = t;
+    }
+
+    return tag;
+}
+
+/* Read a definite-length byte or text string. */
+static int cbor_string(cbor_t *c, uint8_t major, const uint8_t **s,
+                       uint64_t *len)
+{
+    if (cbor_expect(c, major, len) || *len == CBOR_INDEFINITE ||
+        (uint64_t)(c->end - c->p) < *len) {
+        return -1;
+    }
+
+    *s = c->p;
+    c->p += *len;
+
+    return 0;
+}
+
+/*
+ * Iterate over a map with unsigned integer keys: calls 'fn' with 'c'
+ * positioned on the value of each key; the callback must consume it.
+ * Other keys are skipped.
+ */
+static int cbor_map(cbor_t *c, int (*fn)(spdm_corim_t *, cbor_t *, uint64_t,
+                                         void *),
+                    spdm_corim_t *corim, void *arg)
+{
+    uint64_t len, i, key;
+    uint8_t major;
+    cbor_t k;
+
+    if (cbor_expect(c, CBOR_MAP, &len)) {
+        return -1;
+    }
+
+    for (i = 0; len == CBOR_INDEFINITE || i < len; i++) {
+        if (len == CBOR_INDEFINITE && cbor_at_break(c)) {
+            break;
+        }
+        k = *c;
+        if (!cbor_head(&k, &major, &key) && major == CBOR_UINT) {
+            c->p = k.p;
+            if (fn(corim, c, key, arg)) {
+                return -1;
+            }
+        } else if (cbor_skip(c) || cbor_skip(c)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Iterate over an array, calling 'fn' on each element. */
+static int cbor_array(cbor_t *c, int (*fn)(spdm_corim_t *, cbor_t *, void *),
+                      spdm_corim_t *corim, void *arg)
+{
+    uint64_t len, i;
+
+    if (cbor_expect(c, CBOR_ARRAY, &len)) {
+        return -1;
+    }
+
+    for (i = 0; len == CBOR_INDEFINITE || i < len; i++) {
+        if (len == CBOR_INDEFINITE && cbor_at_break(c)) {
+            break;
+        }
+        if (fn(corim, c, arg)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int corim_alg_id(cbor_t *c, uint16_t *alg)
+{
+    const uint8_t *s;
+    char name[16];
+    uint64_t val;
+    uint8_t major;
+    cbor_t t = *c;
+
+    if (cbor_head(&t, &major, &val)) {
+        return -1;
+    }
+    if (major == CBOR_UINT) {
+        *c = t;
+        *alg = val;
+        return 0;
+    }
+
+    /* Text names as in the named information registry, e.g. "sha-384". */
+    if (cbor_string(c, CBOR_TSTR, &s, &val) || val >= sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, s, val);
+    name[val] = '\0';
+    if (!strncmp(name, "sha-", 4)) {
+        memmove(name + 3, name + 4, val - 3);
+    } else if (!strncmp(name, "sha3-", 5)) {
+        name[4] = '_';
+    }
+    *alg = spdm_meas_alg_id(name);
+
+    return 0;
+}
+
+static uint32_t corim_hash(uint32_t env, uint8_t kind, uint8_t index,
+                           uint16_t alg, const uint8_t *value, uint32_t len)
+{
+    uint32_t h = 2166136261U, i;
+
+    h = (h ^ env) * 16777619U;
+    h = (h ^ kind) * 16777619U;
+    h = (h ^ index) * 16777619U;
+    h = (h ^ (alg & 0xFF)) * 16777619U;
+    h = (h ^ (alg >> 8)) * 16777619U;
+    for (i = 0; i < len; i++) {
+        h = (h ^ value[i]) * 16777619U;
+    }
+
+    return h;
+}
+
+static int corim_add_ref(spdm_corim_t *c, uint32_t env, uint8_t kind,
+                         uint8_t index, uint16_t alg, const uint8_t *value,
+                         uint32_t len)
+{
+    spdm_corim_ref_t *refs;
+
+    if (c->nrefs == c->refs_size) {
+        refs = realloc(c->refs, (c->refs_size * 2 + 64) * sizeof(*refs));
+        if (!refs) {
+            return -1;
+        }
+        c->refs = refs;
+        c->refs_size = c->refs_size * 2 + 64;
+    }
+
+    refs = &c->refs[c->nrefs++];
+    refs->env = env;
+    refs->kind = kind;
+    refs->index = index;
+    refs->alg = alg;
+    refs->value = value;
+    refs->len = len;
+    refs->next = 0;
+    c->envs[env].nrefs[kind][index]++;
+
+    return 0;
+}
+
+/* SVN references are few, and matched by range, so a list does. */
+static int corim_add_svn(spdm_corim_t *c, uint32_t env, uint8_t index,
+                         bool min, uint64_t svn)
+{
+    spdm_corim_svn_t *svns;
+
+    if (c->nsvns == c->svns_size) {
+        svns = realloc(c->svns, (c->svns_size * 2 + 16) * sizeof(*svns));
+        if (!svns) {
+            return -1;
+        }
+        c->svns = svns;
+        c->svns_size = c->svns_size * 2 + 16;
+    }
+
+    svns = &c->svns[c->nsvns++];
+    svns->env = env;
+    svns->index = index;
+    svns->min = min;
+    svns->svn = svn;
+    c->envs[env].nsvns[index]++;
+
+    return 0;
+}
+
+/* Rebuild the hash buckets, sized to twice the number of references. */
+static int corim_rehash(spdm_corim_t *c)
+{
+    spdm_corim_ref_t *r;
+    uint32_t n = 16, i, b, *buckets;
+
+    while (n < c->nrefs * 2) {
+        n <<= 1;
+    }
+
+    /* The old buckets stay for a rollback if this fails. */
+    buckets = calloc(n, sizeof(*buckets));
+    if (!buckets) {
+        return -1;
+    }
+    free(c->buckets);
+    c->buckets = buckets;
+    c->nbuckets = n;
+
+    for (i = 0; i < c->nrefs; i++) {
+        r = &c->refs[i];
+        b = corim_hash(r->env, r->kind, r->index, r->alg, r->value,
+                       r->len) & (n - 1);
+        r->next = c->buckets[b];
+        c->buckets[b] = i + 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Drop what a failed load added, back to the given counts. The hash chains
+ * of the references kept are untouched, as only corim_rehash() sets them.
+ */
+static void corim_rollback(spdm_corim_t *c, uint32_t nrefs, uint32_t nsvns,
+                           uint32_t nenvs)
+{
+    spdm_corim_ref_t *r;
+    spdm_corim_svn_t *svn;
+
+    while (c->nrefs > nrefs) {
+        r = &c->refs[--c->nrefs];
+        c->envs[r->env].nrefs[r->kind][r->index]--;
+    }
+    while (c->nsvns > nsvns) {
+        svn = &c->svns[--c->nsvns];
+        c->envs[svn->env].nsvns[svn->index]--;
+    }
+    c->nenvs = nenvs;
+}
+
+/* Measurement being decoded. */
+typedef struct corim_meas {
+    uint32_t env;
+    bool has_index;
+    uint8_t index;
+    cbor_t mval;                /* measurement-values-map, decoded last */
+} corim_meas_t;
+
+static int corim_digest(spdm_corim_t *c, cbor_t *cb, void *arg)
+{
+    corim_meas_t *m = arg;
+    const uint8_t *digest;
+    uint64_t len;
+    uint16_t alg;
+
+    if (cbor_expect(cb, CBOR_ARRAY, &len) || len != 2 ||
+        corim_alg_id(cb, &alg) ||
+        cbor_string(cb, CBOR_BSTR, &digest, &len)) {
+        return -1;
+    }
+
+    return corim_add_ref(c, m->env, SPDM_CORIM_REF_DIGEST, m->index, alg,
+                         digest, len);
+}
+
+static int corim_mval(spdm_corim_t *c, cbor_t *cb, uint64_t key, void *arg)
+{
+    corim_meas_t *m = arg;
+    const uint8_t *raw;
+    uint64_t tag, val;
+
+    switch (key) {
+    case MVAL_SVN:
+        tag = cbor_untag(cb);
+        if (cbor_expect(cb, CBOR_UINT, &val)) {
+            return -1;
+        }
+        return corim_add_svn(c, m->env, m->index, tag == TAG_MIN_SVN, val);
+
+    case MVAL_DIGESTS:
+        return cbor_array(cb, corim_digest, c, m);
+
+    case MVAL_RAW_VALUE:
+        cbor_untag(cb);
+        if (cbor_string(cb, CBOR_BSTR, &raw, &val)) {
+            return -1;
+        }
+        return corim_add_ref(c, m->env, SPDM_CORIM_REF_RAW, m->index, 0, raw,
+                             val);
+
+    default:
+        return cbor_skip(cb);
+    }
+}
+
+static int corim_meas_key(spdm_corim_t *c, cbor_t *cb, uint64_t key,
+                          void *arg)
+{
+    corim_meas_t *m = arg;
+    uint64_t val;
+    uint8_t major;
+    cbor_t t;
+
+    switch (key) {
+    case MEAS_MKEY:
+        /* Only uint keys are SPDM measurement indices. */
+        t = *cb;
+        if (!cbor_head(&t, &major, &val) && major == CBOR_UINT &&
+            val < 256) {
+            m->has_index = true;
+            m->index = val;
+        }
+        return cbor_skip(cb);
+
+    case MEAS_MVAL:
+        m->mval = *cb;
+        return cbor_skip(cb);
+
+    default:
+        return cbor_skip(cb);
+    }
+}
+
+static int corim_measurement(spdm_corim_t *c, cbor_t *cb, void *arg)
+{
+    corim_meas_t m = { .env = *(uint32_t *)arg };
+
+    if (cbor_map(cb, corim_meas_key, c, &m)) {
+        return -1;
+    }
+    if (!m.has_index || !m.mval.p) {
+        return 0;
+    }
+
+    return cbor_map(&m.mval, corim_mval, c, &m);
+}
+
+static int corim_class(spdm_corim_t *c, cbor_t *cb, uint64_t key, void *arg)
+{
+    spdm_corim_env_t *e = arg;
+    const uint8_t *s;
+    uint64_t len;
+    size_t n;
+
+    if (key != CLASS_VENDOR && key != CLASS_MODEL) {
+        return cbor_skip(cb);
+    }
+    if (cbor_string(cb, CBOR_TSTR, &s, &len)) {
+        return -1;
+    }
+
+    n = strlen(e->name);
+    snprintf(e->name + n, sizeof(e->name) - n, "%s%.*s", n ? " " : "",
+             (int)len, s);
+
+    return 0;
+}
+
+static int corim_env_key(spdm_corim_t *c, cbor_t *cb, uint64_t key,
+                         void *arg)
+{
+    if (key == ENV_CLASS) {
+        return cbor_map(cb, corim_class, c, arg);
+    }
+
+    return cbor_skip(cb);
+}
+
+/* Find or add the environment of a triple. */
+static int corim_env(spdm_corim_t *c, cbor_t *cb, uint32_t *env)
+{
+    const uint8_t *id = cb->p;
+    spdm_corim_env_t *e;
+    cbor_t t = *cb;
+    uint32_t i, len;
+
+    if (cbor_skip(cb)) {
+        return -1;
+    }
+    len = cb->p - id;
+
+    for (i = 0; i < c->nenvs; i++) {
+        if (c->envs[i].id_len == len && !memcmp(c->envs[i].id, id, len)) {
+            *env = i;
+            return 0;
+        }
+    }
+
+    e = realloc(c->envs, (c->nenvs + 1) * sizeof(*e));
+    if (!e) {
+        return -1;
+    }
+    c->envs = e;
+    e = &c->envs[c->nenvs];
+    memset(e, 0, sizeof(*e));
+    e->id = id;
+    e->id_len = len;
+    if (cbor_map(&t, corim_env_key, c, e)) {
+        return -1;
+    }
+    if (!e->name[0]) {
+        snprintf(e->name, sizeof(e->name), "environment %u", c->nenvs);
+    }
+    *env = c->nenvs++;
+
+    return 0;
+}
+
+static int corim_ref_triple(spdm_corim_t *c, cbor_t *cb, void *arg)
+{
+    uint64_t len;
+    uint32_t env;
+
+    /* [environment-map, [+ measurement-map]] */
+    if (cbor_expect(cb, CBOR_ARRAY, &len) || len != 2 ||
+        corim_env(c, cb, &env)) {
+        return -1;
+    }
+
+    return cbor_array(cb, corim_measurement, c, &env);
+}
+
+static int corim_triples(spdm_corim_t *c, cbor_t *cb, uint64_t key,
+                         void *arg)
+{
+    if (key == TRIPLES_REFERENCE) {
+        return cbor_array(cb, corim_ref_triple, c, NULL);
+    }
+
+    return cbor_skip(cb);
+}
+
+static int corim_comid(spdm_corim_t *c, cbor_t *cb, uint64_t key, void *arg)
+{
+    if (key == COMID_TRIPLES) {
+        return cbor_map(cb, corim_triples, c, NULL);
+    }
+
+    return cbor_skip(cb);
+}
+
+static int corim_decode(spdm_corim_t *c, cbor_t *cb, int depth);
+
+static int corim_tag(spdm_corim_t *c, cbor_t *cb, void *arg)
+{
+    return corim_decode(c, cb, *(int *)arg + 1);
+}
+
+/* Read a time, #6.1(int or float seconds since the epoch). */
+static int corim_time(cbor_t *c, double *t)
+{
+    const uint8_t *p;
+    uint64_t val;
+    uint8_t major;
+    uint32_t f32;
+    double f64;
+    float f;
+
+    if (cbor_untag(c) != TAG_EPOCH_TIME) {
+        return -1;
+    }
+    p = c->p;
+    if (cbor_head(c, &major, &val)) {
+        return -1;
+    }
+
+    switch (major) {
+    case CBOR_UINT:
+        *t = val;
+        return 0;
+    case CBOR_NINT:
+        *t = -1.0 - val;
+        return 0;
+    case CBOR_SIMPLE:
+        if ((*p & 0x1F) == 26) {
+            f32 = val;
+            memcpy(&f, &f32, sizeof(f));
+            *t = f;
+            return 0;
+        }
+        if ((*p & 0x1F) == 27) {
+            memcpy(&f64, &val, sizeof(f64));
+            *t = f64;
+            return 0;
+        }
+        return -1;
+    default:
+        return -1;
+    }
+}
+
+static int corim_validity(spdm_corim_t *c, cbor_t *cb, uint64_t key,
+                          void *arg)
+{
+    double t, now = time(NULL);
+
+    if (key != VALIDITY_NOT_BEFORE && key != VALIDITY_NOT_AFTER) {
+        return cbor_skip(cb);
+    }
+    if (corim_time(cb, &t)) {
+        return -1;
+    }
+
+    if (key == VALIDITY_NOT_BEFORE && now < t) {
+        c->error = "CoRIM not valid yet";
+        return -1;
+    }
+    if (key == VALIDITY_NOT_AFTER && now > t) {
+        c->error = "CoRIM expired";
+        return -1;
+    }
+
+    return 0;
+}
+
+static int corim_map(spdm_corim_t *c, cbor_t *cb, uint64_t key, void *arg)
+{
+    switch (key) {
+    case CORIM_TAGS:
+        return cbor_array(cb, corim_tag, c, arg);
+
+    case CORIM_RIM_VALIDITY:
+        return cbor_map(cb, corim_validity, c, NULL);
+
+    default:
+        /* id, dependent-rims, profile, entities */
+        return cbor_skip(cb);
+    }
+}
+
+/*
+ * Tell an untagged corim-map, with an array of tags at key 1, from a
+ * concise-mid-tag, with a tag-identity map there.
+ */
+static int corim_peek(spdm_corim_t *c, cbor_t *cb, uint64_t key, void *arg)
+{
+    uint64_t val;
+    uint8_t major;
+    cbor_t t = *cb;
+
+    if (key == CORIM_TAGS && !cbor_head(&t, &major, &val) &&
+        major == CBOR_ARRAY) {
+        *(bool *)arg = true;
+    }
+
+    return cbor_skip(cb);
+}
+
+/*
+ * Decode a CoRIM / CoMID item: a signed or unsigned CoRIM, a CoMID, or a
+ * byte string wrapping one of them.
+ */
+static int corim_decode(spdm_corim_t *c, cbor_t *cb, int depth)
+{
+    const uint8_t *payload;
+    bool is_corim;
+    uint64_t tag, len;
+    uint8_t major;
+    cbor_t t;
+
+    if (depth > 8) {
+        return -1;
+    }
+
+    tag = cbor_untag(cb);
+
+    t = *cb;
+    if (cbor_head(&t, &major, &len)) {
+        return -1;
+    }
+
+    switch (major) {
+    case CBOR_BSTR:
+        if (cbor_string(cb, CBOR_BSTR, &payload, &len)) {
+            return -1;
+        }
+        t.p = payload;
+        t.end = payload + len;
+        return corim_decode(c, &t, depth + 1);
+
+    case CBOR_ARRAY:
+        /* COSE_Sign1: the payload is the third element. */
+        if (tag != TAG_COSE_SIGN1 || len != 4) {
+            return cbor_skip(cb);
+        }
+        *cb = t;
+        if (cbor_skip(cb) || cbor_skip(cb) ||
+            corim_decode(c, cb, depth + 1)) {
+            return -1;
+        }
+        return cbor_skip(cb);
+
+    case CBOR_MAP:
+        is_corim = tag == TAG_CORIM;
+        if (tag != TAG_CORIM && tag != TAG_COMID) {
+            t = *cb;
+            if (cbor_map(&t, corim_peek, c, &is_corim)) {
+                return -1;
+            }
+        }
+        return cbor_map(cb, is_corim ? corim_map : corim_comid, c, &depth);
+
+    default:
+        return cbor_skip(cb);
+    }
+}
+
+int spdm_corim_load(spdm_corim_t *c, const char *path)
+{
+    uint32_t nrefs = c->nrefs, nsvns = c->nsvns, nenvs = c->nenvs;
+    uint8_t **files, *buf;
+    cbor_t cb;
+    long size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        printf("%s: %m\n", path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = malloc(size ? size : 1);
+    if (!buf || fread(buf, 1, size, fp) != (size_t)size) {
+        printf("%s: read error\n", path);
+        fclose(fp);
+        free(buf);
+        return -1;
+    }
+    fclose(fp);
+
+    /* References point into the file, so keep it. */
+    files = realloc(c->files, (c->nfiles + 1) * sizeof(*files));
+    if (!files) {
+        free(buf);
+        return -1;
+    }
+    c->files = files;
+    c->files[c->nfiles++] = buf;
+
+    cb.p = buf;
+    cb.end = buf + size;
+    c->error = NULL;
+    if (corim_decode(c, &cb, 0)) {
+        printf("%s: %s\n", path, c->error ? c->error : "malformed CoRIM");
+        goto fail;
+    }
+    if (c->nrefs + c->nsvns == nrefs + nsvns) {
+        printf("%s: no reference values\n", path);
+    }
+
+    if (corim_rehash(c)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    /* Leave the reference values of the files loaded before as they were. */
+    corim_rollback(c, nrefs, nsvns, nenvs);
+    free(c->files[--c->nfiles]);
+    return -1;
+}
+
+void spdm_corim_free(spdm_corim_t *c)
+{
+    uint32_t i;
+
+    for (i = 0; i < c->nfiles; i++) {
+        free(c->files[i]);
+    }
+    free(c->files);
+    free(c->envs);
+    free(c->refs);
+    free(c->svns);
+    free(c->buckets);
+    memset(c, 0, sizeof(*c));
+}
+
+static bool corim_lookup(const spdm_corim_t *c, uint32_t env, uint8_t kind,
+                         uint8_t index, uint16_t alg, const uint8_t *value,
+                         uint32_t len)
+{
+    const spdm_corim_ref_t *r;
+    uint32_t i;
+
+    if (!c->nbuckets) {
+        return false;
+    }
+
+    i = c->buckets[corim_hash(env, kind, index, alg, value, len) &
+                   (c->nbuckets - 1)];
+    for (; i; i = r->next) {
+        r = &c->refs[i - 1];
+        if (r->env == env && r->kind == kind && r->index == index &&
+            r->alg == alg && r->len == len &&
+            !memcmp(r->value, value, len)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+spdm_corim_result_t spdm_corim_match(const spdm_corim_t *c, uint32_t env,
+                                     const spdm_meas_block_t *blk, int alg)
+{
+    const spdm_corim_env_t *e = &c->envs[env];
+    const spdm_corim_svn_t *svn;
+    uint64_t val = 0;
+    uint32_t j;
+    int i;
+
+    /*
+     * An index pinned by reference values of another kind doesn't match:
+     * the device must not get around them by changing the representation.
+     */
+    if (!spdm_corim_has_ref(c, env, blk->index)) {
+        return SPDM_CORIM_NO_REF;
+    }
+
+    if (spdm_meas_is_digest(blk)) {
+        if (!e->nrefs[SPDM_CORIM_REF_DIGEST][blk->index]) {
+            return SPDM_CORIM_MISMATCH;
+        }
+        if (!alg) {
+            alg = spdm_meas_alg_id_by_size(blk->value_size);
+        }
+        return corim_lookup(c, env, SPDM_CORIM_REF_DIGEST, blk->index, alg,
+                            blk->value, blk->value_size) ?
+               SPDM_CORIM_MATCH : SPDM_CORIM_MISMATCH;
+    }
+
+    if (spdm_meas_is_svn(blk)) {
+        for (i = 7; i >= 0; i--) {
+            val = (val << 8) | blk->value[i];
+        }
+        for (j = 0; j < c->nsvns; j++) {
+            svn = &c->svns[j];
+            if (svn->env == env && svn->index == blk->index &&
+                (svn->min ? val >= svn->svn : val == svn->svn)) {
+                return SPDM_CORIM_MATCH;
+            }
+        }
+        return SPDM_CORIM_MISMATCH;
+    }
+
+    /* Raw value: the measurement after the DMTF header. */
+    if (!e->nrefs[SPDM_CORIM_REF_RAW][blk->index] || !blk->value) {
+        return SPDM_CORIM_MISMATCH;
+    }
+    return corim_lookup(c, env, SPDM_CORIM_REF_RAW, blk->index, 0,
+                        blk->value, blk->size - SPDM_MEAS_DMTF_HDR_SIZE) ?
+           SPDM_CORIM_MATCH : SPDM_CORIM_MISMATCH;
+}
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* CoRIM / CoMID reference value matcher header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_CORIM_H_
+#define _SPDM_CORIM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spdm_meas.h"
+
+/* Reference value kinds, hashed. SVNs are kept in a list. */
+#define SPDM_CORIM_REF_DIGEST   0U
+#define SPDM_CORIM_REF_RAW      1U
+#define SPDM_CORIM_REF_KINDS    2U
+
+/* Reference value in the hash index. */
+typedef struct spdm_corim_ref {
+    uint8_t kind;               /* SPDM_CORIM_REF_* */
+    uint8_t index;              /* measurement index */
+    uint16_t alg;               /* CoRIM hash algorithm id for digests */
+    uint32_t env;               /* environment */
+    uint32_t len;               /* value length */
+    const uint8_t *value;       /* value, points into the loaded file */
+    uint32_t next;              /* next entry in the bucket, +1 */
+} spdm_corim_ref_t;
+
+/* SVN reference of a measurement index. */
+typedef struct spdm_corim_svn {
+    uint32_t env;               /* environment */
+    uint8_t index;              /* measurement index */
+    bool min;                   /* minimum SVN instead of exact SVN */
+    uint64_t svn;
+} spdm_corim_svn_t;
+
+/*
+ * Environment (class / instance / group) the reference values describe.
+ * Triples with byte-identical environment-maps share one environment,
+ * across CoMIDs and files.
+ */
+typedef struct spdm_corim_env {
+    const uint8_t *id;          /* environment-map, points into the file */
+    uint32_t id_len;
+    char name[64];              /* class vendor and model, for reports */
+    uint32_t nrefs[SPDM_CORIM_REF_KINDS][256]; /* references per index */
+    uint32_t nsvns[256];        /* SVN references per index */
+} spdm_corim_env_t;
+
+/*
+ * Reference values loaded from one or more CoRIM / CoMID files, indexed by
+ * environment, measurement index, kind, algorithm and value.
+ */
+typedef struct spdm_corim {
+    uint8_t **files;            /* loaded files */
+    uint32_t nfiles;
+    spdm_corim_env_t *envs;     /* environments */
+    uint32_t nenvs;
+    spdm_corim_ref_t *refs;     /* digest and raw reference values */
+    uint32_t nrefs;
+    uint32_t refs_size;
+    uint32_t *buckets;          /* hash buckets, first entry +1 */
+    uint32_t nbuckets;
+    spdm_corim_svn_t *svns;     /* SVN reference values */
+    uint32_t nsvns;
+    uint32_t svns_size;
+    const char *error;          /* why decoding failed, if not malformed */
+} spdm_corim_t;
+
+/* Result of matching a measurement block. */
+typedef enum spdm_corim_result {
+    SPDM_CORIM_NO_REF,          /* no reference value for this block */
+    SPDM_CORIM_MATCH,           /* matches a reference value */
+    SPDM_CORIM_MISMATCH,        /* doesn't match any reference value */
+} spdm_corim_result_t;
+
+/*
+ * Load reference values
+ *
+ * The file may be a COSE_Sign1 signed CoRIM, an unsigned CoRIM or a single
+ * CoMID, in CBOR. All reference-value triples are loaded, per environment.
+ * A CoRIM outside its rim-validity period is rejected; the COSE signature
+ * is not checked. Can be called more than once to load several files; a
+ * file that fails to load leaves the ones loaded before as they were.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_corim_load(spdm_corim_t *c, const char *path);
+
+void spdm_corim_free(spdm_corim_t *c);
+
+/*
+ * Match a measurement block against the reference values of an environment
+ *
+ * env: environment, below c->nenvs
+ * blk: measurement block from spdm_meas_next()
+ * alg: CoRIM hash algorithm id of digest measurements
+ *
+ * A block matches if it equals any reference value of its index and kind:
+ * digest, raw value, or one of the SVNs. It doesn't if its index only has
+ * reference values of other kinds; SPDM_CORIM_NO_REF is only for an index
+ * without any.
+ */
+spdm_corim_result_t spdm_corim_match(const spdm_corim_t *c, uint32_t env,
+                                     const spdm_meas_block_t *blk, int alg);
+
+/* Check whether an index has any reference value in an environment. */
+static inline bool spdm_corim_has_ref(const spdm_corim_t *c, uint32_t env,
+                                      uint8_t index)
+{
+    const spdm_corim_env_t *e = &c->envs[env];
+
+    return e->nrefs[SPDM_CORIM_REF_DIGEST][index] ||
+           e->nrefs[SPDM_CORIM_REF_RAW][index] || e->nsvns[index];
+}
+
+#endif /* _SPDM_CORIM_H_ */
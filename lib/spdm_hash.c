@@ -0,0 +1,482 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* Multi-buffer SHA-384 / SHA-512 with runtime CPU dispatch.
+ *
+ * SHA-384 is SHA-512 with another initial state and a truncated digest,
+ * so everything below is SHA-512 compression. Multi-buffer kernels run
+ * one compression per lane on independent buffers: a lane that finishes
+ * its buffer is refilled with the next one while the others go on.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA512
+#define HWCAP_SHA512    (1 << 21)
+#endif
+#endif
+#include "spdm_hash.h"
+
+#define SHA512_BLOCK_SIZE   128U
+#define SHA512_MAX_LANES    4U
+
+typedef struct spdm_hash_ops {
+    const char *name;
+    uint32_t lanes;
+    /* Compress blocks of one buffer. */
+    void (*compress)(uint64_t state[8], const uint8_t *data, size_t blocks);
+    /* Compress one block per lane, state is state[word][lane]. */
+    void (*compress_lanes)(uint64_t state[8][SHA512_MAX_LANES],
+                           const uint8_t *const block[SHA512_MAX_LANES]);
+} spdm_hash_ops_t;
+
+/* Buffer being hashed in a lane. */
+typedef struct spdm_hash_lane {
+    uint32_t buf;               /* buffer index */
+    const uint8_t *data;        /* next block */
+    size_t blocks;              /* full blocks left in the buffer */
+    uint32_t tail_blocks;       /* padding blocks left */
+    uint8_t tail[2 * SHA512_BLOCK_SIZE];
+} spdm_hash_lane_t;
+
+static const uint64_t sha512_k[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+    0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+    0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+    0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+    0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+    0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+    0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+    0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+    0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+    0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+    0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+    0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+    0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+    0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+    0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+    0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+    0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+    0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+    0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+    0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+    0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static const uint64_t sha384_iv[8] = {
+    0xcbbb9d5dc1059ed8ULL, 0x629a292a367cd507ULL, 0x9159015a3070dd17ULL,
+    0x152fecd8f70e5939ULL, 0x67332667ffc00b31ULL, 0x8eb44a8768581511ULL,
+    0xdb0c2e0d64f98fa7ULL, 0x47b5481dbefa4fa4ULL,
+};
+
+static const uint64_t sha512_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+    0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static inline uint64_t spdm_hash_be64(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+static inline uint64_t ror64(uint64_t x, unsigned int n)
+{
+    return (x >> n) | (x << (64 - n));
+}
+
+static void sha512_compress_portable(uint64_t state[8], const uint8_t *data,
+                                     size_t blocks)
+{
+    uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+    int t;
+
+    for (; blocks; blocks--, data += SHA512_BLOCK_SIZE) {
+        for (t = 0; t < 16; t++) {
+            w[t] = spdm_hash_be64(data + 8 * t);
+        }
+        for (t = 16; t < 80; t++) {
+            w[t] = w[t - 16] + w[t - 7] +
+                   (ror64(w[t - 15], 1) ^ ror64(w[t - 15], 8) ^
+                    (w[t - 15] >> 7)) +
+                   (ror64(w[t - 2], 19) ^ ror64(w[t - 2], 61) ^
+                    (w[t - 2] >> 6));
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+        for (t = 0; t < 80; t++) {
+            t1 = h + (ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41)) +
+                 ((e & f) ^ (~e & g)) + sha512_k[t] + w[t];
+            t2 = (ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39)) +
+                 ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+static const spdm_hash_ops_t spdm_hash_portable = {
+    .name = "portable",
+    .lanes = 1,
+    .compress = sha512_compress_portable,
+    .compress_lanes = NULL,
+};
+
+#if defined(__x86_64__)
+#define AVX2_ROR(x, n) \
+    _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+
+/* Four independent blocks, one per 64-bit element. */
+__attribute__((target("avx2")))
+static void sha512_compress_lanes_avx2(
+    uint64_t state[8][SHA512_MAX_LANES],
+    const uint8_t *const block[SHA512_MAX_LANES])
+{
+    __m256i w[16], s[8], t1, t2, x;
+    int t, i;
+
+    for (i = 0; i < 8; i++) {
+        s[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+    }
+
+    for (t = 0; t < 80; t++) {
+        if (t < 16) {
+            w[t] = _mm256_set_epi64x(spdm_hash_be64(block[3] + 8 * t),
+                                     spdm_hash_be64(block[2] + 8 * t),
+                                     spdm_hash_be64(block[1] + 8 * t),
+                                     spdm_hash_be64(block[0] + 8 * t));
+        } else {
+            x = w[(t - 15) & 15];
+            t1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(x, 1),
+                                                   AVX2_ROR(x, 8)),
+                                  _mm256_srli_epi64(x, 7));
+            x = w[(t - 2) & 15];
+            t2 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(x, 19),
+                                                   AVX2_ROR(x, 61)),
+                                  _mm256_srli_epi64(x, 6));
+            w[t & 15] = _mm256_add_epi64(
+                _mm256_add_epi64(w[t & 15], w[(t - 7) & 15]),
+                _mm256_add_epi64(t1, t2));
+        }
+
+        /* t1 = h + S1(e) + Ch(e, f, g) + k + w */
+        x = s[4];
+        t1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(x, 14),
+                                               AVX2_ROR(x, 18)),
+                              AVX2_ROR(x, 41));
+        t1 = _mm256_add_epi64(t1, _mm256_xor_si256(
+                                      _mm256_and_si256(x, s[5]),
+                                      _mm256_andnot_si256(x, s[6])));
+        t1 = _mm256_add_epi64(t1, _mm256_add_epi64(s[7], w[t & 15]));
+        t1 = _mm256_add_epi64(t1, _mm256_set1_epi64x(sha512_k[t]));
+
+        /* t2 = S0(a) + Maj(a, b, c) */
+        x = s[0];
+        t2 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROR(x, 28),
+                                               AVX2_ROR(x, 34)),
+                              AVX2_ROR(x, 39));
+        t2 = _mm256_add_epi64(t2, _mm256_or_si256(
+                                      _mm256_and_si256(x, s[1]),
+                                      _mm256_and_si256(s[2],
+                                                       _mm256_or_si256(x,
+                                                                       s[1]))));
+
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = _mm256_add_epi64(s[3], t1);
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = _mm256_add_epi64(t1, t2);
+    }
+
+    for (i = 0; i < 8; i++) {
+        x = _mm256_loadu_si256((const __m256i *)state[i]);
+        _mm256_storeu_si256((__m256i *)state[i], _mm256_add_epi64(x, s[i]));
+    }
+}
+
+static const spdm_hash_ops_t spdm_hash_avx2 = {
+    .name = "avx2",
+    .lanes = 4,
+    .compress = sha512_compress_portable,
+    .compress_lanes = sha512_compress_lanes_avx2,
+};
+#endif /* __x86_64__ */
+
+#if defined(__aarch64__)
+/*
+ * Two rounds with the SHA-512 instructions. ab, cd, ef, gh hold the state
+ * as word pairs, and tmp gets the new ef; the caller rotates the names
+ * the way the words move: ab <- gh, cd <- ab, ef <- tmp, gh <- ef.
+ */
+#define SHA512_CE_ROUNDS(ab, cd, ef, gh, tmp, kw)                       \
+    do {                                                                \
+        uint64x2_t _fg = vextq_u64(ef, gh, 1);                          \
+        uint64x2_t _de = vextq_u64(cd, ef, 1);                          \
+        gh = vaddq_u64(gh, vextq_u64(kw, kw, 1));                       \
+        gh = vsha512hq_u64(gh, _fg, _de);                               \
+        tmp = vaddq_u64(cd, gh);                                        \
+        gh = vsha512h2q_u64(gh, cd, ab);                                \
+    } while (0)
+
+__attribute__((target("arch=armv8.2-a+sha3")))
+static void sha512_compress_ce(uint64_t state[8], const uint8_t *data,
+                               size_t blocks)
+{
+    uint64x2_t s[5], save[4], w[8], kw;
+    int t, i, ab, cd, ef, gh, tmp, next;
+
+    for (i = 0; i < 4; i++) {
+        s[i] = vld1q_u64(state + 2 * i);
+    }
+
+    for (; blocks; blocks--, data += SHA512_BLOCK_SIZE) {
+        for (i = 0; i < 4; i++) {
+            save[i] = s[i];
+        }
+        for (i = 0; i < 8; i++) {
+            w[i] = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        ab = 0;
+        cd = 1;
+        ef = 2;
+        gh = 3;
+        tmp = 4;
+        for (t = 0; t < 40; t++) {
+            kw = vaddq_u64(w[t & 7], vld1q_u64(sha512_k + 2 * t));
+            if (t < 32) {
+                /* w[t + 8] pair: sigma0 of the next, sigma1 of t + 7. */
+                w[t & 7] = vsha512su1q_u64(
+                    vsha512su0q_u64(w[t & 7], w[(t + 1) & 7]),
+                    w[(t + 7) & 7],
+                    vextq_u64(w[(t + 4) & 7], w[(t + 5) & 7], 1));
+            }
+            SHA512_CE_ROUNDS(s[ab], s[cd], s[ef], s[gh], s[tmp], kw);
+
+            next = gh;
+            gh = ef;
+            ef = tmp;
+            tmp = cd;
+            cd = ab;
+            ab = next;
+        }
+
+        /* 40 rotations of 5 registers end where they started. */
+        for (i = 0; i < 4; i++) {
+            s[i] = vaddq_u64(s[i], save[i]);
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        vst1q_u64(state + 2 * i, s[i]);
+    }
+}
+
+static const spdm_hash_ops_t spdm_hash_ce = {
+    .name = "armv8-sha512",
+    .lanes = 1,
+    .compress = sha512_compress_ce,
+    .compress_lanes = NULL,
+};
+#endif /* __aarch64__ */
+
+static const spdm_hash_ops_t *m_ops = &spdm_hash_portable;
+static pthread_once_t m_ops_once = PTHREAD_ONCE_INIT;
+
+static void spdm_hash_select(void)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        m_ops = &spdm_hash_avx2;
+    }
+#elif defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_SHA512) {
+        m_ops = &spdm_hash_ce;
+    }
+#endif
+}
+
+/* Set up padding: the partial last block, 0x80, zeros, bit length. */
+static void spdm_hash_lane_start(spdm_hash_lane_t *lane, uint32_t buf,
+                                 const uint8_t *data, size_t len)
+{
+    size_t rem = len % SHA512_BLOCK_SIZE;
+    uint64_t bits = (uint64_t)len << 3;
+    uint8_t *end;
+    int i;
+
+    lane->buf = buf;
+    lane->data = data;
+    lane->blocks = len / SHA512_BLOCK_SIZE;
+    lane->tail_blocks = rem + 17 > SHA512_BLOCK_SIZE ? 2 : 1;
+    if (!lane->blocks) {
+        lane->data = lane->tail;
+    }
+
+    memset(lane->tail, 0, lane->tail_blocks * SHA512_BLOCK_SIZE);
+    memcpy(lane->tail, data + len - rem, rem);
+    lane->tail[rem] = 0x80;
+    end = lane->tail + lane->tail_blocks * SHA512_BLOCK_SIZE;
+    /* The upper half of the 128-bit length stays 0. */
+    for (i = 0; i < 8; i++) {
+        end[-1 - i] = bits >> (8 * i);
+    }
+}
+
+static const uint8_t *spdm_hash_lane_next(spdm_hash_lane_t *lane)
+{
+    const uint8_t *block = lane->data;
+
+    if (lane->blocks) {
+        lane->blocks--;
+        lane->data = lane->blocks ? block + SHA512_BLOCK_SIZE : lane->tail;
+    } else {
+        lane->tail_blocks--;
+        /* Padding follows in the tail buffer. */
+        lane->data = lane->tail_blocks ? block + SHA512_BLOCK_SIZE : NULL;
+    }
+
+    return block;
+}
+
+static void spdm_hash_output(const uint64_t *state, size_t stride,
+                             uint32_t digest_size, uint8_t *digest)
+{
+    uint32_t i;
+
+    for (i = 0; i < digest_size; i++) {
+        digest[i] = state[(i / 8) * stride] >> (56 - 8 * (i % 8));
+    }
+}
+
+/* One buffer at a time, the whole buffer per compress call. */
+static void spdm_hash_single(const spdm_hash_ops_t *ops, const uint64_t *iv,
+                             uint32_t digest_size, const uint8_t *data,
+                             size_t len, uint8_t *digest)
+{
+    spdm_hash_lane_t lane;
+    uint64_t state[8];
+
+    memcpy(state, iv, sizeof(state));
+    spdm_hash_lane_start(&lane, 0, data, len);
+    ops->compress(state, data, lane.blocks);
+    ops->compress(state, lane.tail, lane.tail_blocks);
+    spdm_hash_output(state, 1, digest_size, digest);
+}
+
+int spdm_hash_mb(uint32_t digest_size, uint32_t n,
+                 const uint8_t *const data[], const size_t len[],
+                 uint8_t *const digest[])
+{
+    static const uint8_t idle_block[SHA512_BLOCK_SIZE];
+    spdm_hash_lane_t lanes[SHA512_MAX_LANES];
+    uint64_t state[8][SHA512_MAX_LANES];
+    const uint8_t *block[SHA512_MAX_LANES];
+    const spdm_hash_ops_t *ops;
+    bool active[SHA512_MAX_LANES] = { false };
+    uint32_t next = 0, nactive = 0, l, i;
+    const uint64_t *iv;
+
+    if (digest_size == SPDM_HASH_SHA384_SIZE) {
+        iv = sha384_iv;
+    } else if (digest_size == SPDM_HASH_SHA512_SIZE) {
+        iv = sha512_iv;
+    } else {
+        return -1;
+    }
+
+    pthread_once(&m_ops_once, spdm_hash_select);
+    ops = m_ops;
+
+    if (ops->lanes == 1 || n == 1) {
+        for (i = 0; i < n; i++) {
+            spdm_hash_single(ops, iv, digest_size, data[i], len[i],
+                             digest[i]);
+        }
+        return 0;
+    }
+
+    for (;;) {
+        /* Refill idle lanes. */
+        for (l = 0; l < ops->lanes; l++) {
+            if (active[l] || next == n) {
+                continue;
+            }
+            spdm_hash_lane_start(&lanes[l], next, data[next], len[next]);
+            for (i = 0; i < 8; i++) {
+                state[i][l] = iv[i];
+            }
+            active[l] = true;
+            nactive++;
+            next++;
+        }
+        if (!nactive) {
+            break;
+        }
+
+        for (l = 0; l < ops->lanes; l++) {
+            block[l] = active[l] ? spdm_hash_lane_next(&lanes[l]) :
+                       idle_block;
+        }
+        ops->compress_lanes(state, block);
+
+        for (l = 0; l < ops->lanes; l++) {
+            if (active[l] && !lanes[l].blocks && !lanes[l].tail_blocks) {
+                spdm_hash_output(&state[0][l], SHA512_MAX_LANES, digest_size,
+                                 digest[lanes[l].buf]);
+                active[l] = false;
+                nactive--;
+            }
+        }
+    }
+
+    return 0;
+}
+
+const char *spdm_hash_impl(void)
+{
+    pthread_once(&m_ops_once, spdm_hash_select);
+    return m_ops->name;
+}
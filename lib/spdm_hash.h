@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* Multi-buffer SHA-384 / SHA-512 header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_HASH_H_
+#define _SPDM_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Digest sizes, also used to select the algorithm. */
+#define SPDM_HASH_SHA384_SIZE   48U
+#define SPDM_HASH_SHA512_SIZE   64U
+
+/*
+ * Hash independent buffers
+ *
+ * The implementation is picked at first use from what the CPU supports:
+ * ARMv8.2 SHA-512 instructions, 4 buffers at once with AVX2, or portable
+ * code. Buffers are hashed side by side where the implementation can.
+ *
+ * digest_size: SPDM_HASH_SHA384_SIZE or SPDM_HASH_SHA512_SIZE
+ * n: number of buffers
+ * data, len: buffers
+ * digest: where to store the digest of each buffer
+ *
+ * Returns 0 on success or -1 for an unsupported digest size.
+ */
+int spdm_hash_mb(uint32_t digest_size, uint32_t n,
+                 const uint8_t *const data[], const size_t len[],
+                 uint8_t *const digest[]);
+
+/* Hash one buffer, see spdm_hash_mb(). */
+static inline int spdm_hash(uint32_t digest_size, const uint8_t *data,
+                            size_t len, uint8_t *digest)
+{
+    return spdm_hash_mb(digest_size, 1, &data, &len, &digest);
+}
+
+/* Name of the implementation in use, e.g. "avx2". */
+const char *spdm_hash_impl(void);
+
+#endif /* _SPDM_HASH_H_ */
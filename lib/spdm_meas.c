@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* SPDM measurement record parser.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "spdm_meas.h"
+
+static const struct {
+    const char *name;
+    int id;
+} spdm_meas_algs[] = {
+    { "sha256", 1 },
+    { "sha384", 7 },
+    { "sha512", 8 },
+    { "sha3_256", 10 },
+    { "sha3_384", 11 },
+    { "sha3_512", 12 },
+};
+
+static inline uint16_t spdm_meas_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+int spdm_meas_next(const uint8_t *rec, size_t len, size_t *offset,
+                   spdm_meas_block_t *blk)
+{
+    const uint8_t *p;
+
+    if (*offset == len)
+        return 0;
+    if (*offset + SPDM_MEAS_BLOCK_HDR_SIZE > len)
+        return -1;
+
+    p = rec + *offset;
+    blk->raw = p;
+    blk->index = p[0];
+    blk->spec = p[1];
+    blk->size = spdm_meas_get16(p + 2);
+    if (*offset + SPDM_MEAS_BLOCK_HDR_SIZE + blk->size > len)
+        return -1;
+
+    /* The DMTF header is only known for the DMTF specification. */
+    blk->value_type = 0;
+    blk->value_size = 0;
+    blk->value = NULL;
+    if (blk->spec == SPDM_MEAS_SPEC_DMTF) {
+        if (blk->size < SPDM_MEAS_DMTF_HDR_SIZE)
+            return -1;
+        p += SPDM_MEAS_BLOCK_HDR_SIZE;
+        blk->value_type = p[0];
+        blk->value_size = spdm_meas_get16(p + 1);
+        if (blk->value_size > blk->size - SPDM_MEAS_DMTF_HDR_SIZE)
+            return -1;
+        blk->value = p + SPDM_MEAS_DMTF_HDR_SIZE;
+    }
+
+    *offset += SPDM_MEAS_BLOCK_HDR_SIZE + blk->size;
+
+    return 1;
+}
+
+int spdm_meas_index(const uint8_t *rec, size_t len,
+                    spdm_meas_block_t *blocks)
+{
+    spdm_meas_block_t blk;
+    size_t offset = 0;
+    int rc, count = 0;
+
+    memset(blocks, 0, 256 * sizeof(*blocks));
+
+    while ((rc = spdm_meas_next(rec, len, &offset, &blk)) > 0) {
+        blocks[blk.index] = blk;
+        count++;
+    }
+
+    return rc ? -1 : count;
+}
+
+int spdm_meas_alg_id(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(spdm_meas_algs) / sizeof(spdm_meas_algs[0]); i++) {
+        if (!strcmp(name, spdm_meas_algs[i].name))
+            return spdm_meas_algs[i].id;
+    }
+
+    return 0;
+}
+
+int spdm_meas_alg_id_by_size(uint16_t size)
+{
+    switch (size) {
+    case 32:
+        return 1;
+    case 48:
+        return 7;
+    case 64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+uint32_t spdm_hash_size(uint32_t base_hash_algo)
+{
+    switch (base_hash_algo) {
+    case SPDM_HASH_SHA_256:
+        return 32;
+    case SPDM_HASH_SHA_384:
+        return 48;
+    case SPDM_HASH_SHA_512:
+        return 64;
+    default:
+        return 0;
+    }
+}
+
+uint32_t spdm_asym_signature_size(uint32_t base_asym_algo)
+{
+    switch (base_asym_algo) {
+    case SPDM_ASYM_ECDSA_P256:
+        return 64;
+    case SPDM_ASYM_ECDSA_P384:
+        return 96;
+    case SPDM_ASYM_ECDSA_P521:
+        return 132;
+    default:
+        return 0;
+    }
+}
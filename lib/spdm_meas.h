@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* SPDM measurement record parser header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_MEAS_H_
+#define _SPDM_MEAS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Measurement specification: DMTF. */
+#define SPDM_MEAS_SPEC_DMTF             0x01U
+
+/* DMTF measurement value type. Bit 7 is set for raw bit stream values. */
+#define SPDM_MEAS_TYPE_MASK             0x7FU
+#define SPDM_MEAS_TYPE_RAW_BIT_STREAM   0x80U
+#define SPDM_MEAS_TYPE_SVN              0x07U
+
+/* BaseHashAlgo. */
+#define SPDM_HASH_SHA_256               0x00000001U
+#define SPDM_HASH_SHA_384               0x00000002U
+#define SPDM_HASH_SHA_512               0x00000004U
+
+/* MeasurementHashAlgo. */
+#define SPDM_MEAS_HASH_RAW_BIT_STREAM   0x00000001U
+#define SPDM_MEAS_HASH_SHA_256          0x00000002U
+#define SPDM_MEAS_HASH_SHA_384          0x00000004U
+#define SPDM_MEAS_HASH_SHA_512          0x00000008U
+
+/* BaseAsymAlgo. */
+#define SPDM_ASYM_ECDSA_P256            0x00000010U
+#define SPDM_ASYM_ECDSA_P384            0x00000080U
+#define SPDM_ASYM_ECDSA_P521            0x00000100U
+
+/* Measurement block header (index, spec, size) and DMTF header (type, size). */
+#define SPDM_MEAS_BLOCK_HDR_SIZE        4U
+#define SPDM_MEAS_DMTF_HDR_SIZE         3U
+
+/**
+ * Parsed measurement block
+ *
+ * The value points into the measurement record, nothing is copied.
+ */
+typedef struct spdm_meas_block {
+    uint8_t index;              /* measurement index */
+    uint8_t spec;               /* measurement specification */
+    uint16_t size;              /* measurement size, DMTF header included */
+    uint8_t value_type;         /* DMTF measurement value type */
+    uint16_t value_size;        /* DMTF measurement value size */
+    const uint8_t *value;       /* DMTF measurement value */
+    const uint8_t *raw;         /* whole block, header included */
+} spdm_meas_block_t;
+
+/*
+ * Get the next measurement block
+ *
+ * This API walks a measurement record as saved in device_measurement.bin,
+ * i.e. the concatenated measurement blocks of a MEASUREMENTS response.
+ *
+ * rec: measurement record
+ * len: measurement record length
+ * offset: offset of the next block, 0 to start; advanced on return
+ * blk: parsed block
+ *
+ * Returns 1 if a block is returned, 0 at the end of the record, or -1 if
+ * the record is malformed.
+ */
+int spdm_meas_next(const uint8_t *rec, size_t len, size_t *offset,
+                   spdm_meas_block_t *blk);
+
+/*
+ * Index a measurement record
+ *
+ * blocks: array of 256 entries filled by measurement index; 'raw' is NULL
+ *         for indices not in the record
+ *
+ * Returns the number of blocks, or -1 if the record is malformed.
+ */
+int spdm_meas_index(const uint8_t *rec, size_t len,
+                    spdm_meas_block_t *blocks);
+
+/* Get the size of the whole block, header included. */
+static inline size_t spdm_meas_block_size(const spdm_meas_block_t *blk)
+{
+    return SPDM_MEAS_BLOCK_HDR_SIZE + blk->size;
+}
+
+/* Check whether the block is a DMTF digest measurement. */
+static inline int spdm_meas_is_digest(const spdm_meas_block_t *blk)
+{
+    return blk->spec == SPDM_MEAS_SPEC_DMTF && blk->value &&
+           !(blk->value_type & SPDM_MEAS_TYPE_RAW_BIT_STREAM);
+}
+
+/* Check whether the block is a DMTF security version number. */
+static inline int spdm_meas_is_svn(const spdm_meas_block_t *blk)
+{
+    return blk->spec == SPDM_MEAS_SPEC_DMTF && blk->value &&
+           (blk->value_type & SPDM_MEAS_TYPE_RAW_BIT_STREAM) &&
+           (blk->value_type & SPDM_MEAS_TYPE_MASK) == SPDM_MEAS_TYPE_SVN &&
+           blk->value_size >= sizeof(uint64_t);
+}
+
+/*
+ * Get the CoRIM hash algorithm id
+ *
+ * Returns the IANA Named Information hash algorithm id used in the 'digest'
+ * evidence ("sha256", "sha384", "sha512", "sha3_256", ...), or 0 if the
+ * name is unknown.
+ */
+int spdm_meas_alg_id(const char *name);
+
+/* Guess the CoRIM hash algorithm id from the digest size, or 0. */
+int spdm_meas_alg_id_by_size(uint16_t size);
+
+/* Get the size of a hash for a BaseHashAlgo value, or 0. */
+uint32_t spdm_hash_size(uint32_t base_hash_algo);
+
+/* Get the size of a signature for a BaseAsymAlgo value, or 0. */
+uint32_t spdm_asym_signature_size(uint32_t base_asym_algo);
+
+#endif /* _SPDM_MEAS_H_ */
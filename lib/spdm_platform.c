@@ -0,0 +1,379 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* spdm-emu platform protocol, shared by spdm-proxy and requesters talking
+ * to it.
+ *
+ * Copyright (C) 2022-2023 NVIDIA CORPORATION.
+ * Copyright 2021-2022 DMTF. All rights reserved.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "spdm_platform.h"
+
+uint32_t m_use_transport_layer = SOCKET_TRANSPORT_TYPE_MCTP;
+
+/**
+ * Read number of bytes data in blocking mode.
+ *
+ * If there is no enough data in socket, this function will wait.
+ * This function will return if enough data is read, or socket error.
+ **/
+bool read_bytes(const int socket, uint8_t *buffer,
+                uint32_t number_of_bytes)
+{
+    int32_t result;
+    uint32_t number_received;
+
+    number_received = 0;
+    while (number_received < number_of_bytes) {
+        result = recv(socket, (char *)(buffer + number_received),
+                      number_of_bytes - number_received, 0);
+        if (result == -1) {
+            printf("Receive error - %m\n");
+            return false;
+        }
+        if (result == 0) {
+            return false;
+        }
+        number_received += result;
+    }
+    return true;
+}
+
+bool read_data32(const int socket, uint32_t *data)
+{
+    bool result;
+
+    result = read_bytes(socket, (uint8_t *)data, sizeof(uint32_t));
+    if (!result) {
+        return result;
+    }
+    *data = ntohl(*data);
+    return true;
+}
+
+/**
+ * Read multiple bytes in blocking mode.
+ *
+ * The length is presented as first 4 bytes in big endian.
+ * The data follows the length.
+ *
+ * If there is no enough data in socket, this function will wait.
+ * This function will return if enough data is read, or socket error.
+ **/
+bool read_multiple_bytes(const int socket, uint8_t *buffer,
+                         uint32_t *bytes_received,
+                         uint32_t max_buffer_length)
+{
+    uint32_t length;
+    bool result;
+
+    result = read_data32(socket, &length);
+    if (!result) {
+        return result;
+    }
+
+    *bytes_received = length;
+    if (*bytes_received > max_buffer_length) {
+        printf("buffer too small (0x%x). Expected - 0x%x\n",
+               max_buffer_length, *bytes_received);
+        return false;
+    }
+    if (length == 0) {
+        return true;
+    }
+    result = read_bytes(socket, buffer, length);
+    if (!result) {
+        return result;
+    }
+
+    return true;
+}
+
+bool receive_platform_data(const int socket, uint32_t *command,
+                           uint8_t *buffer,
+                           uint32_t *size)
+{
+    bool result;
+    uint32_t response;
+    uint32_t transport_type;
+    uint32_t bytes_received;
+
+    result = read_data32(socket, &response);
+    if (!result) {
+        return result;
+    }
+    *command = response;
+
+    result = read_data32(socket, &transport_type);
+    if (!result) {
+        return result;
+    }
+    if (transport_type != m_use_transport_layer) {
+        printf("transport_type mismatch\n");
+        return false;
+    }
+
+    bytes_received = 0;
+    result = read_multiple_bytes(socket, buffer, &bytes_received,
+                                 (uint32_t)*size);
+    if (!result) {
+        return result;
+    }
+    *size = bytes_received;
+
+    return result;
+}
+
+/**
+ * Write number of bytes data in blocking mode.
+ *
+ * This function will return if data is written, or socket error.
+ **/
+bool write_bytes(const int socket, const uint8_t *buffer,
+                 uint32_t number_of_bytes)
+{
+    int32_t result;
+    uint32_t number_sent;
+
+    number_sent = 0;
+    while (number_sent < number_of_bytes) {
+        /* A requester going away must not kill the proxy with SIGPIPE. */
+        result = send(socket, (char *)(buffer + number_sent),
+                      number_of_bytes - number_sent, MSG_NOSIGNAL);
+        if (result == -1) {
+            printf("Send error - %m\n");
+            return false;
+        }
+        number_sent += result;
+    }
+    return true;
+}
+
+bool write_data32(const int socket, uint32_t data)
+{
+    data = htonl(data);
+    return write_bytes(socket, (uint8_t *)&data, sizeof(uint32_t));
+}
+
+/**
+ * Write multiple bytes.
+ *
+ * The length is presented as first 4 bytes in big endian.
+ * The data follows the length.
+ **/
+bool write_multiple_bytes(const int socket, const uint8_t *buffer,
+                          uint32_t bytes_to_send)
+{
+    bool result;
+
+    result = write_data32(socket, bytes_to_send);
+    if (!result) {
+        return result;
+    }
+
+    result = write_bytes(socket, buffer, bytes_to_send);
+    if (!result) {
+        return result;
+    }
+
+    return true;
+}
+
+bool send_platform_data(const int socket, uint32_t command,
+                        const uint8_t *buffer, uint32_t size)
+{
+    struct iovec iov = { (void *)buffer, size };
+
+    return send_platform_data_vec(socket, command, &iov, 1);
+}
+
+/*
+ * The frame header and payload go out in one sendmsg(), rather than one
+ * send() per field, so the peer isn't left waiting on Nagle and delayed
+ * ACKs for the tail of the frame.
+ */
+bool send_platform_data_vec(const int socket, uint32_t command,
+                            const struct iovec *iov, uint32_t iovcnt)
+{
+    struct iovec vec[1 + 1 + 2 * SPDM_PLATFORM_MAX_BATCH];
+    struct msghdr msg;
+    uint32_t header[3], size = 0, i;
+    ssize_t result;
+
+    if (iovcnt > sizeof(vec) / sizeof(vec[0]) - 1) {
+        printf("too many payload vectors\n");
+        return false;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+        vec[1 + i] = iov[i];
+    }
+    header[0] = htonl(command);
+    header[1] = htonl(m_use_transport_layer);
+    header[2] = htonl(size);
+    vec[0].iov_base = header;
+    vec[0].iov_len = sizeof(header);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = 1 + iovcnt;
+    while (msg.msg_iovlen) {
+        /* A requester going away must not kill the proxy with SIGPIPE. */
+        result = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (result == -1) {
+            printf("Send error - %m\n");
+            return false;
+        }
+        while (msg.msg_iovlen && (size_t)result >= msg.msg_iov->iov_len) {
+            result -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen) {
+            msg.msg_iov->iov_base = (uint8_t *)msg.msg_iov->iov_base + result;
+            msg.msg_iov->iov_len -= result;
+        }
+    }
+
+    return true;
+}
+
+int spdm_platform_connect(const char *host, uint16_t port, bool nodelay)
+{
+    struct sockaddr_in address;
+    int sock;
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        printf("invalid address %s\n", host);
+        return -1;
+    }
+
+    sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1) {
+        printf("Cannot create socket %m\n");
+        return -1;
+    }
+
+    if (connect(sock, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        printf("Connect error %m\n");
+        close(sock);
+        return -1;
+    }
+
+    if (nodelay) {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+    }
+
+    return sock;
+}
+
+bool spdm_platform_xfer(int socket, const uint8_t *req, uint32_t req_len,
+                        uint8_t *rsp, uint32_t *rsp_len)
+{
+    uint32_t command;
+
+    if (!send_platform_data(socket, SOCKET_SPDM_COMMAND_NORMAL, req,
+                            req_len) ||
+        !receive_platform_data(socket, &command, rsp, rsp_len)) {
+        return false;
+    }
+
+    if (command != SOCKET_SPDM_COMMAND_NORMAL) {
+        printf("unexpected platform command %x\n", command);
+        return false;
+    }
+
+    return true;
+}
+
+int spdm_platform_xfer_batch(int socket, uint32_t n,
+                             const uint8_t *const req[],
+                             const uint32_t req_len[], uint8_t *const rsp[],
+                             uint32_t rsp_len[])
+{
+    struct iovec iov[1 + 2 * SPDM_PLATFORM_MAX_BATCH];
+    uint32_t lengths[1 + SPDM_PLATFORM_MAX_BATCH];
+    uint32_t command, transport_type, size, count, length, i;
+
+    if (!n || n > SPDM_PLATFORM_MAX_BATCH) {
+        printf("invalid batch size %u\n", n);
+        return -1;
+    }
+
+    lengths[0] = htonl(n);
+    iov[0].iov_base = &lengths[0];
+    iov[0].iov_len = sizeof(lengths[0]);
+    for (i = 0; i < n; i++) {
+        lengths[1 + i] = htonl(req_len[i]);
+        iov[1 + 2 * i].iov_base = &lengths[1 + i];
+        iov[1 + 2 * i].iov_len = sizeof(lengths[1 + i]);
+        iov[2 + 2 * i].iov_base = (void *)req[i];
+        iov[2 + 2 * i].iov_len = req_len[i];
+    }
+    if (!send_platform_data_vec(socket, SOCKET_SPDM_COMMAND_BATCH, iov,
+                                1 + 2 * n)) {
+        return -1;
+    }
+
+    /* Responses are read straight into the caller's buffers. */
+    if (!read_data32(socket, &command) ||
+        !read_data32(socket, &transport_type) ||
+        !read_data32(socket, &size)) {
+        return -1;
+    }
+    if (command != SOCKET_SPDM_COMMAND_BATCH) {
+        if (command == SOCKET_SPDM_COMMAND_UNKOWN) {
+            printf("platform server without batch support\n");
+        } else {
+            printf("unexpected platform command %x\n", command);
+        }
+        return -1;
+    }
+    if (transport_type != m_use_transport_layer) {
+        printf("transport_type mismatch\n");
+        return -1;
+    }
+    if (size < sizeof(count) || !read_data32(socket, &count)) {
+        return -1;
+    }
+    size -= sizeof(count);
+    if (count > n) {
+        printf("batch reply with %u responses to %u requests\n", count, n);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (size < sizeof(length) || !read_data32(socket, &length)) {
+            return -1;
+        }
+        size -= sizeof(length);
+        if (length > size || length > rsp_len[i]) {
+            printf("batch response %u too large (0x%x)\n", i, length);
+            return -1;
+        }
+        if (!read_bytes(socket, rsp[i], length)) {
+            return -1;
+        }
+        rsp_len[i] = length;
+        size -= length;
+    }
+    if (size) {
+        printf("malformed batch reply\n");
+        return -1;
+    }
+
+    return count;
+}
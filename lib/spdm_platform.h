@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/* spdm-emu platform protocol header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ * Copyright 2021-2022 DMTF. All rights reserved.
+ */
+
+#ifndef _SPDM_PLATFORM_H_
+#define _SPDM_PLATFORM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define DEFAULT_SPDM_PLATFORM_PORT 2323
+
+#define SOCKET_SPDM_COMMAND_NORMAL 0x0001
+#define SOCKET_SPDM_COMMAND_OOB_ENCAP_KEY_UPDATE 0x8001
+#define SOCKET_SPDM_COMMAND_CONTINUE 0xFFFD
+#define SOCKET_SPDM_COMMAND_SHUTDOWN 0xFFFE
+#define SOCKET_SPDM_COMMAND_UNKOWN 0xFFFF
+#define SOCKET_SPDM_COMMAND_TEST 0xDEAD
+/* spdm-proxy extension, see spdm_platform_xfer_batch(). */
+#define SOCKET_SPDM_COMMAND_BATCH 0x4E01
+
+/* Largest message spdm-proxy relays, transport header included. */
+#define SPDM_PLATFORM_MAX_MSG_SIZE (0x1200 + 64)
+/* Most messages in one SOCKET_SPDM_COMMAND_BATCH frame. */
+#define SPDM_PLATFORM_MAX_BATCH 16U
+/* Largest SOCKET_SPDM_COMMAND_BATCH payload. */
+#define SPDM_PLATFORM_MAX_BATCH_SIZE \
+    (4 + SPDM_PLATFORM_MAX_BATCH * (4 + SPDM_PLATFORM_MAX_MSG_SIZE))
+
+enum {
+    SOCKET_TRANSPORT_TYPE_NONE,    /* raw packet */
+    SOCKET_TRANSPORT_TYPE_MCTP,    /* MCTP payload */
+    SOCKET_TRANSPORT_TYPE_PCI_DOE  /* DOE payload */
+};
+
+/* Transport type sent and expected in every frame. */
+extern uint32_t m_use_transport_layer;
+
+/*
+ * Frames are: command, transport type, payload length, all 32-bit big
+ * endian, then the payload. These block until the whole frame is read or
+ * written and return false on socket errors.
+ */
+bool read_bytes(const int socket, uint8_t *buffer, uint32_t number_of_bytes);
+bool read_data32(const int socket, uint32_t *data);
+bool read_multiple_bytes(const int socket, uint8_t *buffer,
+                         uint32_t *bytes_received,
+                         uint32_t max_buffer_length);
+bool receive_platform_data(const int socket, uint32_t *command,
+                           uint8_t *buffer, uint32_t *size);
+
+bool write_bytes(const int socket, const uint8_t *buffer,
+                 uint32_t number_of_bytes);
+bool write_data32(const int socket, uint32_t data);
+bool write_multiple_bytes(const int socket, const uint8_t *buffer,
+                          uint32_t bytes_to_send);
+bool send_platform_data(const int socket, uint32_t command,
+                        const uint8_t *buffer, uint32_t size);
+/* Same with the payload gathered from 'iov', written in one go. */
+bool send_platform_data_vec(const int socket, uint32_t command,
+                            const struct iovec *iov, uint32_t iovcnt);
+
+/*
+ * Connect to a platform server, for requesters
+ *
+ * host: IPv4 address
+ * port: TCP port
+ * nodelay: disable Nagle
+ *
+ * Returns the socket or -1 on failure.
+ */
+int spdm_platform_connect(const char *host, uint16_t port, bool nodelay);
+
+/*
+ * Send one message with SOCKET_SPDM_COMMAND_NORMAL and receive the response
+ *
+ * rsp_len: response buffer length as input, response length as output
+ *
+ * Returns true on success.
+ */
+bool spdm_platform_xfer(int socket, const uint8_t *req, uint32_t req_len,
+                        uint8_t *rsp, uint32_t *rsp_len);
+
+/*
+ * Send several messages in one SOCKET_SPDM_COMMAND_BATCH frame
+ *
+ * The proxy runs them back to back on the mailbox and returns all the
+ * responses in one frame, saving a socket round trip per message. It does
+ * not look into the messages, so only batch requests that don't depend on
+ * the previous responses. The payload of both frames is a 32-bit count
+ * followed by each message as a 32-bit length and the message, all big
+ * endian.
+ *
+ * n: number of messages, up to SPDM_PLATFORM_MAX_BATCH
+ * req, req_len: messages
+ * rsp, rsp_len: response buffers; lengths as input, response lengths as
+ *               output
+ *
+ * Returns the number of responses, fewer than 'n' if the proxy stopped at
+ * a message the mailbox failed, or -1 on failure, including a proxy
+ * without batch support.
+ */
+int spdm_platform_xfer_batch(int socket, uint32_t n,
+                             const uint8_t *const req[],
+                             const uint32_t req_len[], uint8_t *const rsp[],
+                             uint32_t rsp_len[]);
+
+#endif /* _SPDM_PLATFORM_H_ */
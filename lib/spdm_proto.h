@@ -0,0 +1,43 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* SPDM over MCTP message format, shared by the requester and the simulated
+ * PSC responder.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_PROTO_H_
+#define _SPDM_PROTO_H_
+
+/* MCTP message type for SPDM. */
+#define MCTP_MSG_TYPE_SPDM          0x05U
+#define MCTP_HDR_SIZE               1U
+
+/* Request / response codes. */
+#define SPDM_GET_VERSION            0x84U
+#define SPDM_VERSION                0x04U
+#define SPDM_GET_CAPABILITIES       0xE1U
+#define SPDM_CAPABILITIES           0x61U
+#define SPDM_NEGOTIATE_ALGORITHMS   0xE3U
+#define SPDM_ALGORITHMS             0x63U
+#define SPDM_GET_CERTIFICATE        0x82U
+#define SPDM_CERTIFICATE            0x02U
+#define SPDM_GET_MEASUREMENTS       0xE0U
+#define SPDM_MEASUREMENTS           0x60U
+#define SPDM_RESPOND_IF_READY       0xFFU
+#define SPDM_ERROR                  0x7FU
+
+/* Error codes. */
+#define SPDM_ERROR_INVALID_REQUEST      0x01U
+#define SPDM_ERROR_BUSY                 0x03U
+#define SPDM_ERROR_UNSUPPORTED_REQUEST  0x07U
+#define SPDM_ERROR_NOT_READY            0x42U
+
+/* Message sizes, SPDM header included. */
+#define SPDM_HDR_SIZE               4U
+#define SPDM_MEAS_RSP_HDR_SIZE      8U
+#define SPDM_CERT_RSP_HDR_SIZE      8U
+#define SPDM_ALGORITHMS_MIN_SIZE    36U
+#define SPDM_CAPABILITIES_11_SIZE   12U
+
+#endif /* _SPDM_PROTO_H_ */
@@ -0,0 +1,672 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* Minimal SPDM requester over PSC mailbox.
+ *
+ * Only what's needed to collect measurements natively: connection setup
+ * (VCA), GET_CERTIFICATE and GET_MEASUREMENTS, with the L1 transcript kept
+ * for signature verification. Messages are MCTP encoded like the ones
+ * spdm-proxy forwards from spdm_requester_emu.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <unistd.h>
+#include "psc_mailbox.h"
+#include "spdm_proto.h"
+#include "spdm_req.h"
+
+#define SPDM_OPAQUE_DATA_FMT_1      0x02U
+
+#define SPDM_REQ_BUSY_RETRIES       3U
+#define SPDM_REQ_BUSY_WAIT_USEC     10000U
+#define SPDM_REQ_NOT_READY_RETRIES  10U
+
+/* Certificate chain portion per GET_CERTIFICATE, as libspdm. */
+#define SPDM_REQ_CERT_PORTION_SIZE  0x400U
+
+#define SPDM_REQ_BASE_HASH_ALGO     (SPDM_HASH_SHA_256 | SPDM_HASH_SHA_384 | \
+                                     SPDM_HASH_SHA_512)
+#define SPDM_REQ_BASE_ASYM_ALGO     (SPDM_ASYM_ECDSA_P256 | \
+                                     SPDM_ASYM_ECDSA_P384 | \
+                                     SPDM_ASYM_ECDSA_P521)
+
+static inline void spdm_put16(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = val >> 8;
+}
+
+static inline void spdm_put32(uint8_t *p, uint32_t val)
+{
+    spdm_put16(p, val & 0xFFFF);
+    spdm_put16(p + 2, val >> 16);
+}
+
+static inline uint16_t spdm_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t spdm_get32(const uint8_t *p)
+{
+    return spdm_get16(p) | ((uint32_t)spdm_get16(p + 2) << 16);
+}
+
+static bool spdm_req_append(uint8_t *buf, uint32_t *len, uint32_t size,
+                            const uint8_t *data, uint32_t data_len)
+{
+    if (*len + data_len > size) {
+        printf("transcript overflow\n");
+        return false;
+    }
+
+    memcpy(buf + *len, data, data_len);
+    *len += data_len;
+
+    return true;
+}
+
+/* Restart L1, which begins with message A from SPDM 1.2 on. */
+static void spdm_req_reset_l1(spdm_req_t *req)
+{
+    req->l1_len = 0;
+    if (req->version >= SPDM_VERSION_12) {
+        memcpy(req->l1, req->vca, req->vca_len);
+        req->l1_len = req->vca_len;
+    }
+}
+
+/*
+ * Send the request in req->req and receive the response in req->rsp. Busy
+ * and ResponseNotReady errors are handled here, so the caller only gets the
+ * final response to its request.
+ *
+ * Returns the SPDM response length, or 0 on failure.
+ */
+static uint32_t spdm_req_xfer(spdm_req_t *req, uint32_t len)
+{
+    uint8_t *spdm_req = req->req + MCTP_HDR_SIZE;
+    uint8_t *spdm_rsp = req->rsp + MCTP_HDR_SIZE;
+    uint8_t ready[MCTP_HDR_SIZE + SPDM_HDR_SIZE];
+    uint32_t busy = 0, not_ready = 0, rsp_len;
+    const uint8_t *msg = req->req;
+    uint32_t msg_len = MCTP_HDR_SIZE + len;
+    bool result;
+
+    req->req[0] = MCTP_MSG_TYPE_SPDM;
+
+    while (true) {
+        rsp_len = sizeof(req->rsp);
+        if (req->xfer) {
+            result = req->xfer(req->xfer_ctx, msg, msg_len, req->rsp,
+                               &rsp_len);
+        } else {
+            result = psc_mailbox_xfer(PSC_MBOX_SPDM_OPCODE, &req->context_id,
+                                      msg, msg_len, req->rsp, &rsp_len);
+        }
+        if (!result) {
+            return 0;
+        }
+
+        if (rsp_len < MCTP_HDR_SIZE + SPDM_HDR_SIZE ||
+            req->rsp[0] != MCTP_MSG_TYPE_SPDM) {
+            printf("invalid response\n");
+            return 0;
+        }
+        rsp_len -= MCTP_HDR_SIZE;
+
+        if (spdm_rsp[1] != SPDM_ERROR) {
+            return rsp_len;
+        }
+
+        if (spdm_rsp[2] == SPDM_ERROR_BUSY &&
+            busy++ < SPDM_REQ_BUSY_RETRIES) {
+            usleep(SPDM_REQ_BUSY_WAIT_USEC);
+            continue;
+        }
+
+        /*
+         * ResponseNotReady extended data: RDTExponent, RequestCode, Token,
+         * RDTM. Wait for RDT and ask for the response.
+         */
+        if (spdm_rsp[2] == SPDM_ERROR_NOT_READY &&
+            rsp_len >= SPDM_HDR_SIZE + 4U &&
+            not_ready++ < SPDM_REQ_NOT_READY_RETRIES) {
+            usleep(1U << (spdm_rsp[4] > 24 ? 24 : spdm_rsp[4]));
+            ready[0] = MCTP_MSG_TYPE_SPDM;
+            ready[1] = spdm_req[0];
+            ready[2] = SPDM_RESPOND_IF_READY;
+            ready[3] = spdm_rsp[5];
+            ready[4] = spdm_rsp[6];
+            msg = ready;
+            msg_len = sizeof(ready);
+            continue;
+        }
+
+        printf("request 0x%02x failed - error 0x%02x 0x%02x\n", spdm_req[1],
+               spdm_rsp[2], spdm_rsp[3]);
+        return 0;
+    }
+}
+
+/* Send a VCA request and add both messages to message A. */
+static uint32_t spdm_req_vca_xfer(spdm_req_t *req, uint32_t len,
+                                  uint8_t code, uint32_t min_len)
+{
+    uint8_t *spdm_rsp = req->rsp + MCTP_HDR_SIZE;
+    uint32_t rsp_len;
+
+    rsp_len = spdm_req_xfer(req, len);
+    if (!rsp_len) {
+        return 0;
+    }
+
+    if (spdm_rsp[1] != code || rsp_len < min_len) {
+        printf("unexpected response 0x%02x to 0x%02x\n", spdm_rsp[1],
+               req->req[MCTP_HDR_SIZE + 1]);
+        return 0;
+    }
+
+    if (!spdm_req_append(req->vca, &req->vca_len, sizeof(req->vca),
+                         req->req + MCTP_HDR_SIZE, len) ||
+        !spdm_req_append(req->vca, &req->vca_len, sizeof(req->vca),
+                         spdm_rsp, rsp_len)) {
+        return 0;
+    }
+
+    return rsp_len;
+}
+
+int spdm_req_connect(spdm_req_t *req)
+{
+    uint8_t *spdm_req = req->req + MCTP_HDR_SIZE;
+    uint8_t *spdm_rsp = req->rsp + MCTP_HDR_SIZE;
+    uint32_t i, len, rsp_len, count;
+    uint8_t ver;
+
+    req->vca_len = 0;
+    req->version = 0;
+
+    /* GET_VERSION is always sent as version 1.0. */
+    memset(spdm_req, 0, SPDM_HDR_SIZE);
+    spdm_req[0] = SPDM_VERSION_10;
+    spdm_req[1] = SPDM_GET_VERSION;
+    rsp_len = spdm_req_vca_xfer(req, SPDM_HDR_SIZE, SPDM_VERSION,
+                                SPDM_HDR_SIZE + 2U);
+    if (!rsp_len) {
+        return -1;
+    }
+
+    /* Pick the highest version both sides support, 1.1 at least. */
+    count = spdm_rsp[5];
+    for (i = 0; i < count && SPDM_HDR_SIZE + 2U + i * 2U + 2U <= rsp_len;
+         i++) {
+        ver = spdm_get16(spdm_rsp + SPDM_HDR_SIZE + 2U + i * 2U) >> 8;
+        if (ver >= SPDM_VERSION_11 && ver <= SPDM_VERSION_12 &&
+            ver > req->version) {
+            req->version = ver;
+        }
+    }
+    if (!req->version) {
+        printf("no common SPDM version\n");
+        return -1;
+    }
+
+    /* GET_CAPABILITIES: no requester capabilities needed. */
+    len = req->version >= SPDM_VERSION_12 ? 20U : SPDM_CAPABILITIES_11_SIZE;
+    memset(spdm_req, 0, len);
+    spdm_req[0] = req->version;
+    spdm_req[1] = SPDM_GET_CAPABILITIES;
+    if (req->version >= SPDM_VERSION_12) {
+        spdm_put32(spdm_req + 12, SPDM_REQ_MAX_MSG_SIZE - MCTP_HDR_SIZE);
+        spdm_put32(spdm_req + 16, SPDM_REQ_MAX_MSG_SIZE - MCTP_HDR_SIZE);
+    }
+    rsp_len = spdm_req_vca_xfer(req, len, SPDM_CAPABILITIES,
+                                SPDM_CAPABILITIES_11_SIZE);
+    if (!rsp_len) {
+        return -1;
+    }
+    req->rsp_flags = spdm_get32(spdm_rsp + 8);
+
+    /* NEGOTIATE_ALGORITHMS without any algorithm structure. */
+    len = 32U;
+    memset(spdm_req, 0, len);
+    spdm_req[0] = req->version;
+    spdm_req[1] = SPDM_NEGOTIATE_ALGORITHMS;
+    spdm_put16(spdm_req + 4, len);
+    spdm_req[6] = SPDM_MEAS_SPEC_DMTF;
+    if (req->version >= SPDM_VERSION_12) {
+        spdm_req[7] = SPDM_OPAQUE_DATA_FMT_1;
+    }
+    spdm_put32(spdm_req + 8, SPDM_REQ_BASE_ASYM_ALGO);
+    spdm_put32(spdm_req + 12, SPDM_REQ_BASE_HASH_ALGO);
+    rsp_len = spdm_req_vca_xfer(req, len, SPDM_ALGORITHMS,
+                                SPDM_ALGORITHMS_MIN_SIZE);
+    if (!rsp_len) {
+        return -1;
+    }
+    req->meas_spec = spdm_rsp[6];
+    req->meas_hash_algo = spdm_get32(spdm_rsp + 8);
+    req->base_asym_algo = spdm_get32(spdm_rsp + 12);
+    req->base_hash_algo = spdm_get32(spdm_rsp + 16);
+
+    spdm_req_reset_l1(req);
+
+    return 0;
+}
+
+/* Fill a GET_CERTIFICATE request for the portion at 'offset'. */
+static void spdm_req_cert_request(const spdm_req_t *req, uint8_t *spdm_req,
+                                  uint8_t slot, uint32_t offset,
+                                  uint32_t length)
+{
+    spdm_req[0] = req->version;
+    spdm_req[1] = SPDM_GET_CERTIFICATE;
+    spdm_req[2] = slot & 0xF;
+    spdm_req[3] = 0;
+    spdm_put16(spdm_req + 4, offset);
+    spdm_put16(spdm_req + 6, length);
+}
+
+/* Check a CERTIFICATE response and add its portion to the chain. */
+static int spdm_req_cert_portion(const uint8_t *spdm_rsp, uint32_t rsp_len,
+                                 uint8_t *chain, uint32_t *len,
+                                 uint32_t *remainder)
+{
+    uint32_t portion;
+
+    if (spdm_rsp[1] != SPDM_CERTIFICATE || rsp_len < SPDM_CERT_RSP_HDR_SIZE) {
+        printf("unexpected response 0x%02x to GET_CERTIFICATE\n",
+               spdm_rsp[1]);
+        return -1;
+    }
+
+    portion = spdm_get16(spdm_rsp + 4);
+    *remainder = spdm_get16(spdm_rsp + 6);
+    if (!portion || SPDM_CERT_RSP_HDR_SIZE + portion > rsp_len ||
+        *len + portion + *remainder > SPDM_REQ_MAX_CERT_CHAIN_SIZE - 1) {
+        printf("invalid certificate portion\n");
+        return -1;
+    }
+    memcpy(chain + *len, spdm_rsp + SPDM_CERT_RSP_HDR_SIZE, portion);
+    *len += portion;
+
+    return 0;
+}
+
+/*
+ * Request the next 'remainder' bytes of the chain with one xfer_batch()
+ * call, in portions of the size the responder returned for the first one,
+ * which may be less than asked for. Responses are taken in order up to the
+ * first one that isn't the expected portion, such as a Busy error or a
+ * short portion; the caller goes on one request at a time from there, so
+ * errors are still retried.
+ *
+ * Returns the number of portions added, or -1 on failure.
+ */
+static int spdm_req_cert_batch(spdm_req_t *req, uint8_t slot, uint8_t *chain,
+                               uint32_t *len, uint32_t *remainder,
+                               uint32_t portion)
+{
+    const uint8_t *msg[SPDM_REQ_MAX_BATCH];
+    uint32_t msg_len[SPDM_REQ_MAX_BATCH];
+    uint8_t *rsp[SPDM_REQ_MAX_BATCH];
+    uint32_t rsp_len[SPDM_REQ_MAX_BATCH];
+    uint32_t offset = *len, n, i;
+    int count;
+
+    n = (*remainder + portion - 1) / portion;
+    if (n > SPDM_REQ_MAX_BATCH) {
+        n = SPDM_REQ_MAX_BATCH;
+    }
+
+    for (i = 0; i < n; i++) {
+        req->batch_req[i][0] = MCTP_MSG_TYPE_SPDM;
+        spdm_req_cert_request(req, req->batch_req[i] + MCTP_HDR_SIZE, slot,
+                              offset + i * portion, portion);
+        msg[i] = req->batch_req[i];
+        msg_len[i] = MCTP_HDR_SIZE + 8U;
+        rsp[i] = req->batch_rsp[i];
+        rsp_len[i] = sizeof(req->batch_rsp[i]);
+    }
+
+    count = req->xfer_batch(req->xfer_ctx, n, msg, msg_len, rsp, rsp_len);
+    if (count < 0) {
+        return -1;
+    }
+
+    for (i = 0; i < (uint32_t)count && *remainder; i++) {
+        if (*len != offset + i * portion ||
+            rsp_len[i] < MCTP_HDR_SIZE + SPDM_HDR_SIZE ||
+            rsp[i][0] != MCTP_MSG_TYPE_SPDM ||
+            rsp[i][MCTP_HDR_SIZE + 1] != SPDM_CERTIFICATE) {
+            break;
+        }
+        if (spdm_req_cert_portion(rsp[i] + MCTP_HDR_SIZE,
+                                  rsp_len[i] - MCTP_HDR_SIZE, chain, len,
+                                  remainder)) {
+            return -1;
+        }
+    }
+
+    return i;
+}
+
+int spdm_req_get_certificate(spdm_req_t *req, uint8_t slot, uint8_t *chain,
+                             uint32_t *len)
+{
+    uint8_t *spdm_req = req->req + MCTP_HDR_SIZE;
+    uint8_t *spdm_rsp = req->rsp + MCTP_HDR_SIZE;
+    uint32_t rsp_len, remainder = 0, portion = 0;
+    int count;
+
+    if (!req->version) {
+        return -1;
+    }
+    if (!(req->rsp_flags & SPDM_CAP_CERT_CAP)) {
+        printf("certificates not supported\n");
+        return -1;
+    }
+
+    *len = 0;
+    do {
+        if (portion && req->xfer_batch && remainder > portion) {
+            count = spdm_req_cert_batch(req, slot, chain, len, &remainder,
+                                        portion);
+            if (count < 0) {
+                return -1;
+            }
+            if (count) {
+                continue;
+            }
+        }
+
+        spdm_req_cert_request(req, spdm_req, slot, *len,
+                              SPDM_REQ_CERT_PORTION_SIZE);
+        rsp_len = spdm_req_xfer(req, 8U);
+        if (!rsp_len ||
+            spdm_req_cert_portion(spdm_rsp, rsp_len, chain, len,
+                                  &remainder)) {
+            return -1;
+        }
+        /* The responder may return less than asked for; batch by that. */
+        if (!portion) {
+            portion = *len;
+        }
+    } while (remainder);
+
+    return 0;
+}
+
+/*
+ * Check what a GET_MEASUREMENTS request with 'attr' needs from the
+ * responder and drop what the negotiated version doesn't define.
+ *
+ * Returns the attributes to send, or -1 on failure.
+ */
+static int spdm_req_meas_attr(const spdm_req_t *req, uint8_t attr,
+                              uint32_t *sig_len)
+{
+    *sig_len = 0;
+    if (attr & SPDM_MEAS_ATTR_SIGNATURE) {
+        if ((req->rsp_flags & SPDM_CAP_MEAS_CAP_MASK) !=
+            SPDM_CAP_MEAS_CAP_SIG) {
+            printf("signed measurements not supported\n");
+            return -1;
+        }
+        *sig_len = spdm_asym_signature_size(req->base_asym_algo);
+        if (!*sig_len || !spdm_hash_size(req->base_hash_algo)) {
+            printf("unsupported algorithms\n");
+            return -1;
+        }
+    }
+
+    /* RawBitStreamRequested is defined from SPDM 1.2 on. */
+    if (req->version < SPDM_VERSION_12) {
+        attr &= ~SPDM_MEAS_ATTR_RAW_BIT_STREAM;
+    }
+
+    return attr;
+}
+
+/* Build a GET_MEASUREMENTS request. Returns its length, or 0 on failure. */
+static uint32_t spdm_req_meas_request(const spdm_req_t *req,
+                                      uint8_t *spdm_req, uint8_t attr,
+                                      uint8_t op, uint8_t slot)
+{
+    uint32_t len = SPDM_HDR_SIZE;
+
+    spdm_req[0] = req->version;
+    spdm_req[1] = SPDM_GET_MEASUREMENTS;
+    spdm_req[2] = attr;
+    spdm_req[3] = op;
+    if (attr & SPDM_MEAS_ATTR_SIGNATURE) {
+        if (getrandom(spdm_req + len, SPDM_NONCE_SIZE, 0) != SPDM_NONCE_SIZE) {
+            printf("getrandom failed - %m\n");
+            return 0;
+        }
+        len += SPDM_NONCE_SIZE;
+        spdm_req[len++] = slot & 0xF;
+    }
+
+    return len;
+}
+
+/*
+ * Check a MEASUREMENTS response, parse it into 'rsp' and add the request
+ * and the response, but the signature, to L1. A signed response hands out
+ * the transcript and restarts L1.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+static int spdm_req_meas_response(spdm_req_t *req, const uint8_t *spdm_req,
+                                  uint32_t len, const uint8_t *spdm_rsp,
+                                  uint32_t rsp_len, uint32_t sig_len,
+                                  spdm_meas_rsp_t *rsp)
+{
+    uint32_t record_offset;
+
+    if (spdm_rsp[1] != SPDM_MEASUREMENTS ||
+        rsp_len < SPDM_MEAS_RSP_HDR_SIZE + sig_len) {
+        printf("unexpected response 0x%02x to GET_MEASUREMENTS\n",
+               spdm_rsp[1]);
+        return -1;
+    }
+
+    memset(rsp, 0, sizeof(*rsp));
+    rsp->total = spdm_rsp[2];
+    rsp->num_blocks = spdm_rsp[4];
+    rsp->record_len = spdm_rsp[5] | (spdm_rsp[6] << 8) | (spdm_rsp[7] << 16);
+    rsp->record = spdm_rsp + SPDM_MEAS_RSP_HDR_SIZE;
+    if (SPDM_MEAS_RSP_HDR_SIZE + rsp->record_len + sig_len > rsp_len) {
+        printf("invalid measurement record length %u\n", rsp->record_len);
+        return -1;
+    }
+
+    /* Everything but the signature goes into L1. */
+    if (!spdm_req_append(req->l1, &req->l1_len, sizeof(req->l1),
+                         spdm_req, len)) {
+        spdm_req_reset_l1(req);
+        return -1;
+    }
+    record_offset = req->l1_len + SPDM_MEAS_RSP_HDR_SIZE;
+    if (!spdm_req_append(req->l1, &req->l1_len, sizeof(req->l1),
+                         spdm_rsp, rsp_len - sig_len)) {
+        spdm_req_reset_l1(req);
+        return -1;
+    }
+
+    if (sig_len) {
+        /*
+         * Hand out the transcript and restart L1. The transcript stays
+         * valid until the next request since L1 is only rebuilt then.
+         */
+        rsp->transcript = req->l1;
+        rsp->transcript_len = req->l1_len;
+        rsp->record_offset = record_offset;
+        rsp->signature = spdm_rsp + rsp_len - sig_len;
+        rsp->signature_len = sig_len;
+        req->l1_len = 0;
+    }
+
+    return 0;
+}
+
+int spdm_req_get_measurements(spdm_req_t *req, uint8_t attr, uint8_t op,
+                              uint8_t slot, spdm_meas_rsp_t *rsp)
+{
+    uint8_t *spdm_req = req->req + MCTP_HDR_SIZE;
+    uint8_t *spdm_rsp = req->rsp + MCTP_HDR_SIZE;
+    uint32_t len, rsp_len, sig_len;
+    int result;
+
+    if (!req->version) {
+        return -1;
+    }
+
+    /* Restart L1 after the previous signed response was handed out. */
+    if (!req->l1_len) {
+        spdm_req_reset_l1(req);
+    }
+
+    result = spdm_req_meas_attr(req, attr, &sig_len);
+    if (result < 0) {
+        return -1;
+    }
+
+    len = spdm_req_meas_request(req, spdm_req, result, op, slot);
+    if (!len) {
+        return -1;
+    }
+
+    rsp_len = spdm_req_xfer(req, len);
+    if (!rsp_len) {
+        return -1;
+    }
+
+    return spdm_req_meas_response(req, spdm_req, len, spdm_rsp, rsp_len,
+                                  sig_len, rsp);
+}
+
+/*
+ * Without xfer_batch() the requests go one at a time, with the responses
+ * copied to the batch buffers so that all of them stay valid.
+ *
+ * Returns the number of responses, or -1 on failure.
+ */
+static int spdm_req_meas_xfer(spdm_req_t *req, uint32_t n,
+                              const uint8_t *const msg[],
+                              const uint32_t msg_len[], uint8_t *const rsp[],
+                              uint32_t rsp_len[])
+{
+    uint32_t len, i;
+
+    if (req->xfer_batch) {
+        return req->xfer_batch(req->xfer_ctx, n, msg, msg_len, rsp, rsp_len);
+    }
+
+    for (i = 0; i < n; i++) {
+        memcpy(req->req, msg[i], msg_len[i]);
+        len = spdm_req_xfer(req, msg_len[i] - MCTP_HDR_SIZE);
+        if (!len) {
+            return -1;
+        }
+        memcpy(rsp[i], req->rsp, MCTP_HDR_SIZE + len);
+        rsp_len[i] = MCTP_HDR_SIZE + len;
+    }
+
+    return n;
+}
+
+int spdm_req_get_measurements_batch(spdm_req_t *req, uint8_t attr,
+                                    const uint8_t *ops, uint32_t n,
+                                    uint8_t slot, spdm_meas_rsp_t *rsp)
+{
+    const uint8_t *msg[SPDM_REQ_MAX_BATCH];
+    uint32_t msg_len[SPDM_REQ_MAX_BATCH];
+    uint8_t *buf[SPDM_REQ_MAX_BATCH];
+    uint32_t buf_len[SPDM_REQ_MAX_BATCH];
+    uint32_t sig_len, i;
+    uint8_t *spdm_rsp;
+    int result, count;
+
+    if (!req->version) {
+        return -1;
+    }
+    if (!n || n > SPDM_REQ_MAX_BATCH) {
+        printf("invalid batch size %u\n", n);
+        return -1;
+    }
+
+    if (!req->l1_len) {
+        spdm_req_reset_l1(req);
+    }
+
+    result = spdm_req_meas_attr(req, attr, &sig_len);
+    if (result < 0) {
+        return -1;
+    }
+
+    /* Only the last request asks for the signature, and has the nonce. */
+    for (i = 0; i < n; i++) {
+        attr = i == n - 1 ? result : result & ~SPDM_MEAS_ATTR_SIGNATURE;
+        req->batch_req[i][0] = MCTP_MSG_TYPE_SPDM;
+        msg_len[i] = spdm_req_meas_request(req,
+                                           req->batch_req[i] + MCTP_HDR_SIZE,
+                                           attr, ops[i], slot);
+        if (!msg_len[i]) {
+            return -1;
+        }
+        msg_len[i] += MCTP_HDR_SIZE;
+        msg[i] = req->batch_req[i];
+        buf[i] = req->batch_rsp[i];
+        buf_len[i] = sizeof(req->batch_rsp[i]);
+    }
+
+    /*
+     * The responder has run all the requests by the time an error shows, so
+     * a failed one can't be retried on its own without L1 going out of
+     * step. Any error fails the batch and restarts L1, as the responder
+     * does.
+     */
+    count = spdm_req_meas_xfer(req, n, msg, msg_len, buf, buf_len);
+    if (count < 0) {
+        spdm_req_reset_l1(req);
+        return -1;
+    }
+    if ((uint32_t)count < n) {
+        printf("batch stopped after %d of %u requests\n", count, n);
+        spdm_req_reset_l1(req);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        spdm_rsp = buf[i] + MCTP_HDR_SIZE;
+        if (buf_len[i] < MCTP_HDR_SIZE + SPDM_HDR_SIZE ||
+            buf[i][0] != MCTP_MSG_TYPE_SPDM) {
+            printf("invalid response\n");
+            spdm_req_reset_l1(req);
+            return -1;
+        }
+        if (spdm_rsp[1] == SPDM_ERROR) {
+            printf("request 0x%02x failed - error 0x%02x 0x%02x\n",
+                   SPDM_GET_MEASUREMENTS, spdm_rsp[2], spdm_rsp[3]);
+            spdm_req_reset_l1(req);
+            return -1;
+        }
+        if (spdm_req_meas_response(req, msg[i] + MCTP_HDR_SIZE,
+                                   msg_len[i] - MCTP_HDR_SIZE, spdm_rsp,
+                                   buf_len[i] - MCTP_HDR_SIZE,
+                                   i == n - 1 ? sig_len : 0, &rsp[i])) {
+            spdm_req_reset_l1(req);
+            return -1;
+        }
+    }
+
+    return 0;
+}
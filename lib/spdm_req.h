@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* Minimal SPDM requester over PSC mailbox header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_REQ_H_
+#define _SPDM_REQ_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spdm_meas.h"
+
+/* Max SPDM message size, same as the spdm-proxy buffer. */
+#define SPDM_REQ_MAX_MSG_SIZE           (0x1200U + 64U)
+
+/* Max certificate chain size, the chain length field is 16 bits. */
+#define SPDM_REQ_MAX_CERT_CHAIN_SIZE    0x10000U
+
+/* Max VCA / L1 transcript size. */
+#define SPDM_REQ_MAX_TRANSCRIPT_SIZE    0x8000U
+
+/* Max messages per xfer_batch() call and their buffer sizes. */
+#define SPDM_REQ_MAX_BATCH              8U
+#define SPDM_REQ_BATCH_REQ_SIZE         64U
+#define SPDM_REQ_BATCH_RSP_SIZE         SPDM_REQ_MAX_MSG_SIZE
+
+#define SPDM_NONCE_SIZE                 32U
+
+/* SPDM versions. */
+#define SPDM_VERSION_10                 0x10U
+#define SPDM_VERSION_11                 0x11U
+#define SPDM_VERSION_12                 0x12U
+
+/* GET_MEASUREMENTS request attributes. */
+#define SPDM_MEAS_ATTR_SIGNATURE        0x01U
+#define SPDM_MEAS_ATTR_RAW_BIT_STREAM   0x02U
+
+/* GET_MEASUREMENTS operations besides an index. */
+#define SPDM_MEAS_OP_COUNT              0x00U
+#define SPDM_MEAS_OP_ALL                0xFFU
+
+/* CAPABILITIES flags. */
+#define SPDM_CAP_CERT_CAP               0x00000002U
+#define SPDM_CAP_MEAS_CAP_MASK          0x00000018U
+#define SPDM_CAP_MEAS_CAP_SIG           0x00000010U
+
+/* Requester state for one connection. */
+typedef struct spdm_req {
+    /*
+     * Message exchange, MCTP header included. psc_mailbox_xfer() is used
+     * if NULL; set it to go through spdm-proxy instead, for example.
+     */
+    bool (*xfer)(void *ctx, const uint8_t *req, uint32_t req_len,
+                 uint8_t *rsp, uint32_t *rsp_len);
+    void *xfer_ctx;
+
+    /*
+     * Optional exchange of several messages that don't depend on each
+     * other in one go, like spdm_platform_xfer_batch(); gets xfer_ctx too.
+     * Returns the number of responses, which may be fewer than asked, or
+     * -1 on failure.
+     */
+    int (*xfer_batch)(void *ctx, uint32_t n, const uint8_t *const req[],
+                      const uint32_t req_len[], uint8_t *const rsp[],
+                      uint32_t rsp_len[]);
+
+    uint16_t context_id;        /* mailbox context id */
+    uint8_t version;            /* negotiated SPDM version */
+    uint32_t rsp_flags;         /* responder capability flags */
+    uint8_t meas_spec;          /* selected measurement specification */
+    uint32_t meas_hash_algo;    /* selected measurement hash algorithm */
+    uint32_t base_asym_algo;    /* selected signature algorithm */
+    uint32_t base_hash_algo;    /* selected hash algorithm */
+
+    /* Message A: GET_VERSION .. ALGORITHMS. */
+    uint8_t vca[512];
+    uint32_t vca_len;
+
+    /*
+     * L1: measurement messages since the last signed MEASUREMENTS, preceded
+     * by message A from SPDM 1.2 on.
+     */
+    uint8_t l1[SPDM_REQ_MAX_TRANSCRIPT_SIZE];
+    uint32_t l1_len;
+
+    /* Mailbox message buffers, MCTP header included. */
+    uint8_t req[SPDM_REQ_MAX_MSG_SIZE];
+    uint8_t rsp[SPDM_REQ_MAX_MSG_SIZE];
+
+    /* xfer_batch() message buffers. */
+    uint8_t batch_req[SPDM_REQ_MAX_BATCH][SPDM_REQ_BATCH_REQ_SIZE];
+    uint8_t batch_rsp[SPDM_REQ_MAX_BATCH][SPDM_REQ_BATCH_RSP_SIZE];
+} spdm_req_t;
+
+/* MEASUREMENTS response of spdm_req_get_measurements(). */
+typedef struct spdm_meas_rsp {
+    uint8_t total;              /* number of indices for SPDM_MEAS_OP_COUNT */
+    uint8_t num_blocks;         /* number of blocks in the record */
+    const uint8_t *record;      /* measurement record */
+    uint32_t record_len;        /* measurement record length */
+
+    /* Only set for signed responses. */
+    const uint8_t *transcript;  /* L1 transcript, signature excluded */
+    uint32_t transcript_len;    /* L1 transcript length */
+    uint32_t record_offset;     /* offset of the record in the transcript */
+    const uint8_t *signature;   /* signature */
+    uint32_t signature_len;     /* signature length */
+} spdm_meas_rsp_t;
+
+/*
+ * Set up an SPDM connection
+ *
+ * This API runs GET_VERSION, GET_CAPABILITIES and NEGOTIATE_ALGORITHMS
+ * over the PSC mailbox, or req->xfer if set. The mailbox must have been
+ * initialized.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_req_connect(spdm_req_t *req);
+
+/*
+ * Get measurements
+ *
+ * attr: SPDM_MEAS_ATTR_*
+ * op: SPDM_MEAS_OP_COUNT, SPDM_MEAS_OP_ALL or a measurement index
+ * slot: certificate slot for signed measurements
+ * rsp: parsed response, pointing into the requester buffers until the next
+ *      call
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_req_get_measurements(spdm_req_t *req, uint8_t attr, uint8_t op,
+                              uint8_t slot, spdm_meas_rsp_t *rsp);
+
+/*
+ * Get measurements of several indices
+ *
+ * attr: SPDM_MEAS_ATTR_*, SPDM_MEAS_ATTR_SIGNATURE only applies to the last
+ *       request, which then also carries the nonce
+ * ops: measurement indices
+ * n: number of indices, up to SPDM_REQ_MAX_BATCH
+ * slot: certificate slot for signed measurements
+ * rsp: 'n' parsed responses, pointing into the requester buffers until the
+ *      next call
+ *
+ * The requests go together through req->xfer_batch if set, one at a time
+ * otherwise. Each request and response goes into L1 in order, as with as
+ * many spdm_req_get_measurements() calls, so the signed response covers
+ * them all. An error response fails the whole batch and restarts L1.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_req_get_measurements_batch(spdm_req_t *req, uint8_t attr,
+                                    const uint8_t *ops, uint32_t n,
+                                    uint8_t slot, spdm_meas_rsp_t *rsp);
+
+/*
+ * Get a certificate chain
+ *
+ * slot: certificate slot
+ * chain: buffer of SPDM_REQ_MAX_CERT_CHAIN_SIZE bytes, gets the chain as
+ *        saved in device_cert_chain_N.bin
+ * len: chain length
+ *
+ * Once the first portion tells the chain length, the other portions are
+ * requested together through req->xfer_batch if set, each of the size the
+ * first one came back with.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_req_get_certificate(spdm_req_t *req, uint8_t slot, uint8_t *chain,
+                             uint32_t *len);
+
+#endif /* _SPDM_REQ_H_ */
@@ -0,0 +1,307 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* Shared memory attestation snapshot.
+ *
+ * One service collects and verifies the attestation state and publishes it
+ * in a shared memory region; any number of local readers copy it out
+ * without going through the PSC mailbox. The snapshot is guarded by a
+ * sequence lock: the service makes the sequence odd while it writes, and
+ * readers retry if the sequence was odd or changed during their copy, so
+ * readers never block the service nor each other.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "spdm_snapshot.h"
+
+static uint64_t spdm_snapshot_clock(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t spdm_snapshot_now(void)
+{
+    return spdm_snapshot_clock(CLOCK_REALTIME);
+}
+
+/* Copy the fixed fields and the used part of the buffers. */
+static void spdm_snapshot_copy(spdm_snapshot_t *dst,
+                               const spdm_snapshot_t *src)
+{
+    uint32_t record_len = src->record_len;
+    uint32_t chain_len = src->chain_len;
+    uint32_t evidence_len = src->evidence_len;
+
+    /* A torn read may see any length, keep the copy in bounds. */
+    if (record_len > sizeof(src->record)) {
+        record_len = 0;
+    }
+    if (chain_len > sizeof(src->chain)) {
+        chain_len = 0;
+    }
+    if (evidence_len > sizeof(src->evidence)) {
+        evidence_len = 0;
+    }
+
+    dst->generation = src->generation;
+    dst->flags = src->flags;
+    dst->time = src->time;
+    dst->slot = src->slot;
+    dst->record_len = record_len;
+    dst->chain_len = chain_len;
+    dst->evidence_len = evidence_len;
+    memcpy(dst->record, src->record, record_len);
+    memcpy(dst->chain, src->chain, chain_len);
+    memcpy(dst->evidence, src->evidence, evidence_len);
+}
+
+static int spdm_snapshot_map(spdm_snapshot_map_t *map, int prot)
+{
+    map->region = mmap(NULL, sizeof(*map->region), prot, MAP_SHARED,
+                       map->fd, 0);
+    if (map->region == MAP_FAILED) {
+        printf("mmap failed - %m\n");
+        map->region = NULL;
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int spdm_snapshot_create(spdm_snapshot_map_t *map)
+{
+    spdm_snapshot_region_t *region;
+
+    map->fd = shm_open(SPDM_SNAPSHOT_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if (map->fd == -1) {
+        printf("%s: %m\n", SPDM_SNAPSHOT_SHM_NAME);
+        return -1;
+    }
+
+    if (flock(map->fd, LOCK_EX | LOCK_NB)) {
+        printf("%s: %s\n", SPDM_SNAPSHOT_SHM_NAME,
+               errno == EWOULDBLOCK ? "service already running" :
+               strerror(errno));
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+
+    if (ftruncate(map->fd, sizeof(*map->region))) {
+        printf("%s: %m\n", SPDM_SNAPSHOT_SHM_NAME);
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+
+    map->writable = true;
+    if (spdm_snapshot_map(map, PROT_READ | PROT_WRITE)) {
+        return -1;
+    }
+    region = map->region;
+
+    /*
+     * A snapshot left by the previous service is still valid, unless that
+     * one died while writing it.
+     */
+    if (region->magic != SPDM_SNAPSHOT_MAGIC ||
+        region->layout != SPDM_SNAPSHOT_LAYOUT) {
+        memset(region, 0, sizeof(*region));
+        region->layout = SPDM_SNAPSHOT_LAYOUT;
+        __atomic_store_n(&region->magic, SPDM_SNAPSHOT_MAGIC,
+                         __ATOMIC_RELEASE);
+    } else if (region->seq & 1) {
+        region->snapshot.generation = 0;
+        __atomic_store_n(&region->seq, region->seq + 1, __ATOMIC_RELEASE);
+    }
+    region->pid = getpid();
+    region->failures = 0;
+
+    return 0;
+}
+
+void spdm_snapshot_publish(spdm_snapshot_map_t *map, spdm_snapshot_t *snap)
+{
+    spdm_snapshot_region_t *region = map->region;
+    uint32_t seq = region->seq;
+
+    snap->generation = region->snapshot.generation + 1;
+    /* Generation 0 means no snapshot. */
+    if (!snap->generation) {
+        snap->generation = 1;
+    }
+
+    __atomic_store_n(&region->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    spdm_snapshot_copy(&region->snapshot, snap);
+    __atomic_store_n(&region->seq, seq + 2, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&region->failures, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&region->last_attempt, snap->time, __ATOMIC_RELAXED);
+}
+
+void spdm_snapshot_fail(spdm_snapshot_map_t *map)
+{
+    __atomic_fetch_add(&map->region->failures, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&map->region->last_attempt, spdm_snapshot_now(),
+                     __ATOMIC_RELAXED);
+}
+
+bool spdm_snapshot_wait_request(spdm_snapshot_map_t *map, uint32_t *seen,
+                                uint32_t timeout_ms)
+{
+    uint32_t *request = &map->region->request;
+    struct timespec ts;
+    uint32_t cur;
+
+    cur = __atomic_load_n(request, __ATOMIC_ACQUIRE);
+    if (cur == *seen) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        syscall(SYS_futex, request, FUTEX_WAIT, *seen, &ts, NULL, 0);
+        cur = __atomic_load_n(request, __ATOMIC_ACQUIRE);
+    }
+
+    if (cur == *seen) {
+        return false;
+    }
+
+    *seen = cur;
+    return true;
+}
+
+int spdm_snapshot_open(spdm_snapshot_map_t *map)
+{
+    struct stat st;
+
+    map->writable = true;
+    map->fd = shm_open(SPDM_SNAPSHOT_SHM_NAME, O_RDWR, 0);
+    if (map->fd == -1 && errno == EACCES) {
+        map->writable = false;
+        map->fd = shm_open(SPDM_SNAPSHOT_SHM_NAME, O_RDONLY, 0);
+    }
+    if (map->fd == -1) {
+        printf("%s: %m\n", SPDM_SNAPSHOT_SHM_NAME);
+        return -1;
+    }
+
+    /* Created but not sized yet: touching the mapping would SIGBUS. */
+    if (fstat(map->fd, &st) || st.st_size < (off_t)sizeof(*map->region)) {
+        printf("%s: service not ready\n", SPDM_SNAPSHOT_SHM_NAME);
+        close(map->fd);
+        map->fd = -1;
+        return -1;
+    }
+
+    if (spdm_snapshot_map(map, map->writable ? PROT_READ | PROT_WRITE :
+                                               PROT_READ)) {
+        return -1;
+    }
+
+    if (__atomic_load_n(&map->region->magic, __ATOMIC_ACQUIRE) !=
+        SPDM_SNAPSHOT_MAGIC ||
+        map->region->layout != SPDM_SNAPSHOT_LAYOUT) {
+        printf("%s: unsupported snapshot layout\n", SPDM_SNAPSHOT_SHM_NAME);
+        spdm_snapshot_close(map);
+        return -1;
+    }
+
+    return 0;
+}
+
+void spdm_snapshot_close(spdm_snapshot_map_t *map)
+{
+    if (map->region) {
+        munmap(map->region, sizeof(*map->region));
+        map->region = NULL;
+    }
+    if (map->fd != -1) {
+        close(map->fd);
+        map->fd = -1;
+    }
+}
+
+bool spdm_snapshot_service_alive(const spdm_snapshot_map_t *map)
+{
+    pid_t pid = __atomic_load_n(&map->region->pid, __ATOMIC_RELAXED);
+
+    return pid > 0 && (!kill(pid, 0) || errno != ESRCH);
+}
+
+uint32_t spdm_snapshot_generation(const spdm_snapshot_map_t *map)
+{
+    return __atomic_load_n(&map->region->snapshot.generation,
+                           __ATOMIC_ACQUIRE);
+}
+
+int spdm_snapshot_read(const spdm_snapshot_map_t *map, spdm_snapshot_t *snap)
+{
+    const spdm_snapshot_region_t *region = map->region;
+    uint64_t deadline = 0;
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&region->seq, __ATOMIC_ACQUIRE);
+        if (!(seq & 1)) {
+            spdm_snapshot_copy(snap, &region->snapshot);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&region->seq, __ATOMIC_RELAXED) == seq) {
+                break;
+            }
+        }
+
+        /* A writer that never finishes must not hang its readers. */
+        if (!deadline) {
+            deadline = spdm_snapshot_clock(CLOCK_MONOTONIC) +
+                       SPDM_SNAPSHOT_READ_TIMEOUT_MSEC * 1000000ULL;
+        } else if ((seq & 1) && !spdm_snapshot_service_alive(map)) {
+            errno = EOWNERDEAD;
+            return -1;
+        } else if (spdm_snapshot_clock(CLOCK_MONOTONIC) > deadline) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        sched_yield();
+    }
+
+    if (!snap->generation) {
+        errno = ENODATA;
+        return -1;
+    }
+
+    return 0;
+}
+
+int spdm_snapshot_request(spdm_snapshot_map_t *map)
+{
+    if (!map->writable) {
+        return -1;
+    }
+
+    __atomic_fetch_add(&map->region->request, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &map->region->request, FUTEX_WAKE, INT_MAX, NULL,
+            NULL, 0);
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* Shared memory attestation snapshot header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_SNAPSHOT_H_
+#define _SPDM_SNAPSHOT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spdm_req.h"
+#include "spdm_verify.h"
+
+/* Shared memory object, /dev/shm/spdm_snapshot. */
+#define SPDM_SNAPSHOT_SHM_NAME      "/spdm_snapshot"
+
+#define SPDM_SNAPSHOT_MAGIC         0x50414E53U     /* "SNAP" */
+#define SPDM_SNAPSHOT_LAYOUT        1U
+
+#define SPDM_SNAPSHOT_MAX_RECORD    SPDM_REQ_MAX_MSG_SIZE
+#define SPDM_SNAPSHOT_MAX_CHAIN     SPDM_REQ_MAX_CERT_CHAIN_SIZE
+#define SPDM_SNAPSHOT_MAX_EVIDENCE  \
+    (SPDM_EVIDENCE_HDR_SIZE + SPDM_REQ_MAX_TRANSCRIPT_SIZE + 512U)
+
+/* Longest a reader waits for the service to finish writing. */
+#define SPDM_SNAPSHOT_READ_TIMEOUT_MSEC 1000U
+
+/* Snapshot flags. */
+#define SPDM_SNAPSHOT_CHAIN_TRUSTED 0x00000001U /* chain checked to a root */
+
+/*
+ * Verified attestation state
+ *
+ * Only the used part of each buffer is copied in and out.
+ */
+typedef struct spdm_snapshot {
+    uint32_t generation;        /* successful refreshes, 0: none yet */
+    uint32_t flags;             /* SPDM_SNAPSHOT_* */
+    uint64_t time;              /* collection time, ns since the epoch */
+    uint8_t slot;               /* certificate slot */
+    uint32_t record_len;        /* measurement record length */
+    uint32_t chain_len;         /* certificate chain length */
+    uint32_t evidence_len;      /* signed exchange length */
+    uint8_t record[SPDM_SNAPSHOT_MAX_RECORD];
+    uint8_t chain[SPDM_SNAPSHOT_MAX_CHAIN];
+    uint8_t evidence[SPDM_SNAPSHOT_MAX_EVIDENCE];   /* spdm_evidence_t */
+} spdm_snapshot_t;
+
+/* Shared memory region: seqlock protected snapshot and service status. */
+typedef struct spdm_snapshot_region {
+    uint32_t magic;
+    uint32_t layout;
+    uint32_t seq;               /* odd while the snapshot is written */
+    uint32_t request;           /* bumped by readers for a refresh */
+    int32_t pid;                /* service pid */
+    uint32_t failures;          /* failed refreshes in a row */
+    uint64_t last_attempt;      /* time of the last refresh, ns */
+    spdm_snapshot_t snapshot;
+} spdm_snapshot_region_t;
+
+typedef struct spdm_snapshot_map {
+    int fd;
+    bool writable;
+    spdm_snapshot_region_t *region;
+} spdm_snapshot_map_t;
+
+/*
+ * Create and own the region, for the service
+ *
+ * Only one owner at a time: the region stays locked until closed.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_snapshot_create(spdm_snapshot_map_t *map);
+
+/* Publish a snapshot, its generation is set here. */
+void spdm_snapshot_publish(spdm_snapshot_map_t *map, spdm_snapshot_t *snap);
+
+/* Record a failed refresh, the last snapshot stays. */
+void spdm_snapshot_fail(spdm_snapshot_map_t *map);
+
+/*
+ * Wait for a refresh request
+ *
+ * seen: request count already served, updated
+ * timeout_ms: max wait
+ *
+ * Returns true if a refresh was requested.
+ */
+bool spdm_snapshot_wait_request(spdm_snapshot_map_t *map, uint32_t *seen,
+                                uint32_t timeout_ms);
+
+/*
+ * Open the region, for readers
+ *
+ * The region is mapped read-write if permissions allow, which is only
+ * needed by spdm_snapshot_request(). A region the service hasn't sized
+ * yet is not mapped.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_snapshot_open(spdm_snapshot_map_t *map);
+
+void spdm_snapshot_close(spdm_snapshot_map_t *map);
+
+/* Check whether the service that owns the region is running. */
+bool spdm_snapshot_service_alive(const spdm_snapshot_map_t *map);
+
+/*
+ * Generation of the current snapshot
+ *
+ * A plain load, cheap enough to poll for changes before reading.
+ */
+uint32_t spdm_snapshot_generation(const spdm_snapshot_map_t *map);
+
+/*
+ * Copy the current snapshot
+ *
+ * Retries while the service is writing, so the copy is consistent, but
+ * not for longer than SPDM_SNAPSHOT_READ_TIMEOUT_MSEC, nor once the
+ * service is found dead in the middle of a write.
+ *
+ * Returns 0 on success or -1 with errno ENODATA if there is no snapshot
+ * yet, EOWNERDEAD if the service died while writing it or ETIMEDOUT.
+ */
+int spdm_snapshot_read(const spdm_snapshot_map_t *map, spdm_snapshot_t *snap);
+
+/*
+ * Ask the service for a refresh now
+ *
+ * Returns 0 on success or -1 if the region is read-only.
+ */
+int spdm_snapshot_request(spdm_snapshot_map_t *map);
+
+#endif /* _SPDM_SNAPSHOT_H_ */
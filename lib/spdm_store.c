@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* Append-only measurement history store.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spdm_store.h"
+
+#define SPDM_STORE_MAGIC        0x5453494844505353ULL   /* "SSPDHIST" */
+#define SPDM_STORE_VERSION      1U
+
+static int spdm_store_open_file(const char *dir, const char *name,
+                                bool writable)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd == -1) {
+        printf("%s: %m\n", path);
+    }
+
+    return fd;
+}
+
+/* Map a whole file read-only, replacing the previous mapping. */
+static int spdm_store_map(int fd, const uint8_t **map, size_t *map_len,
+                          size_t need)
+{
+    struct stat st;
+    void *p = NULL;
+
+    if (*map && *map_len >= need) {
+        return 0;
+    }
+
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < need) {
+        printf("store file truncated\n");
+        return -1;
+    }
+
+    if (st.st_size) {
+        p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            printf("mmap - %m\n");
+            return -1;
+        }
+    }
+
+    if (*map) {
+        munmap((void *)*map, *map_len);
+    }
+    *map = p;
+    *map_len = st.st_size;
+
+    return 0;
+}
+
+int spdm_store_refresh(spdm_store_t *st)
+{
+    uint32_t count = __atomic_load_n(&st->hdr->count, __ATOMIC_ACQUIRE);
+
+    if (spdm_store_map(st->index_fd, &st->index_map, &st->index_map_len,
+                       SPDM_STORE_HDR_SIZE +
+                       (size_t)count * sizeof(spdm_store_entry_t)) ||
+        spdm_store_map(st->data_fd, &st->data_map, &st->data_map_len,
+                       st->hdr->data_len)) {
+        return -1;
+    }
+
+    st->count = count;
+    st->snapshots = st->hdr->snapshots;
+
+    return 0;
+}
+
+/* Write the header of a new store. Called with the store locked. */
+static int spdm_store_init(int fd)
+{
+    uint8_t page[SPDM_STORE_HDR_SIZE] = { 0 };
+    spdm_store_hdr_t *hdr = (spdm_store_hdr_t *)page;
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+    if (st.st_size >= SPDM_STORE_HDR_SIZE) {
+        return 0;
+    }
+
+    hdr->magic = SPDM_STORE_MAGIC;
+    hdr->version = SPDM_STORE_VERSION;
+    hdr->entry_size = sizeof(spdm_store_entry_t);
+    if (pwrite(fd, page, sizeof(page), 0) != sizeof(page) || fsync(fd)) {
+        printf("store init - %m\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Check the header of an existing store. A writer may have just created
+ * index.dat: its header is written under LOCK_EX, so check it under
+ * LOCK_SH, and from the file, since touching a mapping past the end of
+ * the file raises SIGBUS.
+ */
+static int spdm_store_check(int fd, const char *dir)
+{
+    spdm_store_hdr_t hdr;
+    struct stat st;
+    int rc = -1;
+
+    flock(fd, LOCK_SH);
+    if (fstat(fd, &st) == -1 || st.st_size < SPDM_STORE_HDR_SIZE ||
+        pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        hdr.magic != SPDM_STORE_MAGIC || hdr.version != SPDM_STORE_VERSION ||
+        hdr.entry_size != sizeof(spdm_store_entry_t)) {
+        printf("%s: not a measurement store\n", dir);
+    } else {
+        rc = 0;
+    }
+    flock(fd, LOCK_UN);
+
+    return rc;
+}
+
+int spdm_store_open(spdm_store_t *st, const char *dir, bool writable)
+{
+    void *hdr;
+
+    memset(st, 0, sizeof(*st));
+    st->index_fd = -1;
+    st->data_fd = -1;
+    st->writable = writable;
+
+    if (writable && mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        printf("%s: %m\n", dir);
+        return -1;
+    }
+
+    st->index_fd = spdm_store_open_file(dir, "index.dat", writable);
+    st->data_fd = spdm_store_open_file(dir, "data.dat", writable);
+    if (st->index_fd == -1 || st->data_fd == -1) {
+        goto fail;
+    }
+
+    if (writable) {
+        flock(st->index_fd, LOCK_EX);
+        if (spdm_store_init(st->index_fd)) {
+            flock(st->index_fd, LOCK_UN);
+            goto fail;
+        }
+        flock(st->index_fd, LOCK_UN);
+    }
+
+    if (spdm_store_check(st->index_fd, dir)) {
+        goto fail;
+    }
+
+    hdr = mmap(NULL, SPDM_STORE_HDR_SIZE,
+               writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+               st->index_fd, 0);
+    if (hdr == MAP_FAILED) {
+        printf("mmap - %m\n");
+        goto fail;
+    }
+    st->hdr = hdr;
+
+    if (spdm_store_refresh(st)) {
+        goto fail;
+    }
+
+    return 0;
+
+fail:
+    spdm_store_close(st);
+    return -1;
+}
+
+void spdm_store_close(spdm_store_t *st)
+{
+    if (st->hdr) {
+        munmap(st->hdr, SPDM_STORE_HDR_SIZE);
+    }
+    if (st->index_map) {
+        munmap((void *)st->index_map, st->index_map_len);
+    }
+    if (st->data_map) {
+        munmap((void *)st->data_map, st->data_map_len);
+    }
+    if (st->index_fd != -1) {
+        close(st->index_fd);
+    }
+    if (st->data_fd != -1) {
+        close(st->data_fd);
+    }
+    memset(st, 0, sizeof(*st));
+    st->index_fd = -1;
+    st->data_fd = -1;
+}
+
+uint32_t spdm_store_snapshot_start(const spdm_store_t *st, uint32_t n)
+{
+    uint32_t snapshot = spdm_store_entry(st, n)->snapshot;
+
+    while (n && spdm_store_entry(st, n - 1)->snapshot == snapshot) {
+        n--;
+    }
+
+    return n;
+}
+
+const spdm_store_entry_t *spdm_store_find_in(const spdm_store_t *st,
+                                             uint32_t last, uint8_t kind,
+                                             uint8_t index)
+{
+    const spdm_store_entry_t *e;
+    uint32_t n;
+
+    for (n = spdm_store_snapshot_start(st, last); n <= last; n++) {
+        e = spdm_store_entry(st, n);
+        if (e->kind == kind && e->index == index) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+uint32_t spdm_store_snapshot_end(const spdm_store_t *st, uint64_t time)
+{
+    uint32_t lo = 0, hi = st->count, mid;
+
+    /* Entries are sorted by time: find the last one not after 'time'. */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (spdm_store_entry(st, mid)->time <= time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+const spdm_store_entry_t *spdm_store_find(const spdm_store_t *st,
+                                          uint8_t kind, uint8_t index,
+                                          uint64_t time)
+{
+    uint32_t end = spdm_store_snapshot_end(st, time);
+
+    return end ? spdm_store_find_in(st, end - 1, kind, index) : NULL;
+}
+
+/*
+ * Find a value already in data.dat, whatever its kind and index, so that
+ * values coming back (A -> B -> A) are not written again. Only entries
+ * starting a run of unchanged values can hold a value first.
+ */
+static bool spdm_store_lookup(const spdm_store_t *st, const uint8_t *data,
+                              uint32_t len, uint64_t *offset)
+{
+    const spdm_store_entry_t *e;
+    const uint8_t *p;
+    uint32_t n;
+
+    if (!len) {
+        return false;
+    }
+
+    for (n = st->count; n-- > 0;) {
+        e = spdm_store_entry(st, n);
+        if (e->changed != n || e->len != len) {
+            continue;
+        }
+        p = spdm_store_data(st, e);
+        if (p && !memcmp(p, data, len)) {
+            *offset = e->offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int spdm_store_append(spdm_store_t *st, uint64_t time,
+                      const spdm_store_value_t *values, uint32_t count)
+{
+    const spdm_store_entry_t *prev;
+    const uint8_t *prev_data;
+    spdm_store_entry_t e;
+    uint64_t data_len;
+    uint32_t i, n;
+    int rc = -1;
+
+    if (!st->writable || !count) {
+        return -1;
+    }
+
+    /* One writer at a time; readers never block. */
+    flock(st->index_fd, LOCK_EX);
+
+    if (spdm_store_refresh(st)) {
+        goto out;
+    }
+
+    n = st->count;
+    if (n && time < spdm_store_entry(st, n - 1)->time) {
+        printf("snapshot older than the latest one\n");
+        goto out;
+    }
+
+    /*
+     * Write entries and data past the committed ends. Anything left there
+     * by a writer that died before committing is overwritten.
+     */
+    data_len = st->hdr->data_len;
+    for (i = 0; i < count; i++) {
+        memset(&e, 0, sizeof(e));
+        e.time = time;
+        e.len = values[i].len;
+        e.snapshot = st->snapshots;
+        e.kind = values[i].kind;
+        e.index = values[i].index;
+
+        /* Unchanged values keep the entry where they last changed. */
+        prev = st->count ? spdm_store_find_in(st, st->count - 1, e.kind,
+                                              e.index) : NULL;
+        prev_data = prev ? spdm_store_data(st, prev) : NULL;
+        if (prev_data && prev->len == e.len &&
+            !memcmp(prev_data, values[i].data, e.len)) {
+            e.offset = prev->offset;
+            e.changed = prev->changed;
+        } else if (spdm_store_lookup(st, values[i].data, e.len, &e.offset)) {
+            e.changed = n;
+        } else {
+            if (pwrite(st->data_fd, values[i].data, e.len, data_len) !=
+                e.len) {
+                printf("store data write - %m\n");
+                goto out;
+            }
+            e.offset = data_len;
+            e.changed = n;
+            data_len += e.len;
+        }
+
+        if (pwrite(st->index_fd, &e, sizeof(e),
+                   SPDM_STORE_HDR_SIZE + (off_t)n * sizeof(e)) != sizeof(e)) {
+            printf("store index write - %m\n");
+            goto out;
+        }
+        n++;
+    }
+
+    if (fdatasync(st->data_fd) || fdatasync(st->index_fd)) {
+        printf("store sync - %m\n");
+        goto out;
+    }
+
+    /* Commit: the count is published last. */
+    st->hdr->data_len = data_len;
+    st->hdr->snapshots = st->snapshots + 1;
+    __atomic_store_n(&st->hdr->count, n, __ATOMIC_RELEASE);
+    msync(st->hdr, SPDM_STORE_HDR_SIZE, MS_SYNC);
+
+    rc = spdm_store_refresh(st);
+
+out:
+    flock(st->index_fd, LOCK_UN);
+    return rc;
+}
@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* Append-only measurement history store header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_STORE_H_
+#define _SPDM_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A store is a directory with two files:
+ *
+ *   index.dat: header page, then fixed-size entries sorted by time
+ *   data.dat:  block data; a value already stored is referenced by the
+ *              new entries, not written again
+ *
+ * Every snapshot appends one entry per measurement block and cert chain
+ * digest. Both files are only appended to; a snapshot is committed by
+ * bumping the entry count in the header, so readers that map the files
+ * never see partial snapshots and can use the data in place.
+ */
+
+/* Entry kinds. */
+#define SPDM_STORE_MEAS         0U      /* measurement block, by index */
+#define SPDM_STORE_CERT         1U      /* cert chain digest, by slot */
+
+#define SPDM_STORE_HDR_SIZE     4096U
+
+/* Index file header. */
+typedef struct spdm_store_hdr {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t data_len;          /* committed data length */
+    uint32_t count;             /* committed entries */
+    uint32_t snapshots;         /* committed snapshots */
+} spdm_store_hdr_t;
+
+/* Index entry. */
+typedef struct spdm_store_entry {
+    uint64_t time;              /* collection time, seconds since the epoch */
+    uint64_t offset;            /* value offset in data.dat */
+    uint32_t len;               /* value length */
+    uint32_t snapshot;          /* snapshot number */
+    uint32_t changed;           /* entry where this value first appeared */
+    uint8_t kind;               /* SPDM_STORE_MEAS or SPDM_STORE_CERT */
+    uint8_t index;              /* measurement index or cert slot */
+    uint8_t rsvd[2];
+} spdm_store_entry_t;
+
+typedef struct spdm_store {
+    int index_fd;
+    int data_fd;
+    bool writable;
+    uint32_t count;             /* committed entries as of the last refresh */
+    uint32_t snapshots;         /* committed snapshots as of the last refresh */
+    spdm_store_hdr_t *hdr;      /* shared header page */
+    const uint8_t *index_map;   /* index.dat mapping */
+    size_t index_map_len;
+    const uint8_t *data_map;    /* data.dat mapping */
+    size_t data_map_len;
+} spdm_store_t;
+
+/* Value added to a snapshot. */
+typedef struct spdm_store_value {
+    uint8_t kind;               /* SPDM_STORE_MEAS or SPDM_STORE_CERT */
+    uint8_t index;              /* measurement index or cert slot */
+    const uint8_t *data;
+    uint32_t len;
+} spdm_store_value_t;
+
+/*
+ * Open a store
+ *
+ * dir: store directory, created if writable
+ * writable: open for appending snapshots
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_store_open(spdm_store_t *st, const char *dir, bool writable);
+
+void spdm_store_close(spdm_store_t *st);
+
+/*
+ * Pick up snapshots committed since the store was opened or refreshed.
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_store_refresh(spdm_store_t *st);
+
+/*
+ * Append a snapshot
+ *
+ * time: collection time, not older than the latest snapshot
+ * values: measurement blocks and cert chain digests of the snapshot
+ * count: number of values
+ *
+ * Returns 0 on success or -1 on failure.
+ */
+int spdm_store_append(spdm_store_t *st, uint64_t time,
+                      const spdm_store_value_t *values, uint32_t count);
+
+/* Get entry n, which must be below st->count. */
+static inline const spdm_store_entry_t *
+spdm_store_entry(const spdm_store_t *st, uint32_t n)
+{
+    return (const spdm_store_entry_t *)(st->index_map + SPDM_STORE_HDR_SIZE) +
+           n;
+}
+
+/* Get the value of an entry, in place, or NULL if it's out of data.dat. */
+static inline const uint8_t *spdm_store_data(const spdm_store_t *st,
+                                             const spdm_store_entry_t *e)
+{
+    if (!st->data_map || e->offset > st->data_map_len ||
+        e->len > st->data_map_len - e->offset) {
+        return NULL;
+    }
+
+    return st->data_map + e->offset;
+}
+
+/*
+ * Find the latest snapshot collected at or before a time
+ *
+ * Returns the number of its last entry plus one, or 0 if there is none.
+ */
+uint32_t spdm_store_snapshot_end(const spdm_store_t *st, uint64_t time);
+
+/* Get the number of the first entry of the snapshot holding entry n. */
+uint32_t spdm_store_snapshot_start(const spdm_store_t *st, uint32_t n);
+
+/*
+ * Find a value as of a time
+ *
+ * Returns the entry of the value in the latest snapshot collected at or
+ * before 'time' (UINT64_MAX for the latest snapshot), or NULL if there is
+ * no such snapshot or it doesn't hold the value.
+ */
+const spdm_store_entry_t *spdm_store_find(const spdm_store_t *st,
+                                          uint8_t kind, uint8_t index,
+                                          uint64_t time);
+
+/*
+ * Find a value in the snapshot ending with entry 'last', below st->count
+ *
+ * Unlike a lookup by time, this tells apart snapshots collected at the
+ * same time.
+ *
+ * Returns the entry of the value, or NULL if the snapshot doesn't hold it.
+ */
+const spdm_store_entry_t *spdm_store_find_in(const spdm_store_t *st,
+                                             uint32_t last, uint8_t kind,
+                                             uint8_t index);
+
+#endif /* _SPDM_STORE_H_ */
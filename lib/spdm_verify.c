@@ -0,0 +1,633 @@
+// SPDX-License-Identifier: GPL-2.0-only OR BSD-3-Clause
+
+/* SPDM evidence verification with OpenSSL libcrypto.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/ecdsa.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include "spdm_hash.h"
+#include "spdm_req.h"
+#include "spdm_verify.h"
+
+/* SPDM 1.2 signing context: 4 version prefixes, zero pad, context. */
+#define SPDM_SIGNING_PREFIX_SIZE    16U
+#define SPDM_SIGNING_CONTEXT_SIZE   100U
+#define SPDM_MEAS_SIGNING_CONTEXT   "responder-measurements signing"
+
+/* SPDM cert chain header: length (2), reserved (2), root hash. */
+#define SPDM_CERT_CHAIN_HDR_SIZE    4U
+
+#define SPDM_CHAIN_MAX_CERTS        16
+#define SPDM_CERT_CACHE_BUCKETS     1024U
+
+typedef struct spdm_cert_entry {
+    struct spdm_cert_entry *next;
+    uint8_t digest[SPDM_HASH_SHA384_SIZE];
+} spdm_cert_entry_t;
+
+struct spdm_cert_cache {
+    pthread_rwlock_t lock;
+    spdm_cert_entry_t *buckets[SPDM_CERT_CACHE_BUCKETS];
+    X509_STORE *store;
+    uint64_t verified;
+    uint64_t hits;
+};
+
+/* SHA-384 / SHA-512 with spdm_hash, SHA-256 with libcrypto. */
+static bool spdm_verify_digest(uint32_t size, const uint8_t *data, size_t len,
+                               uint8_t *digest)
+{
+    unsigned int digest_len;
+
+    if (size == SPDM_HASH_SHA384_SIZE || size == SPDM_HASH_SHA512_SIZE) {
+        return !spdm_hash(size, data, len, digest);
+    }
+
+    return size == 32 &&
+           EVP_Digest(data, len, digest, &digest_len, EVP_sha256(), NULL);
+}
+
+spdm_pubkey_t *spdm_chain_leaf_key(const uint8_t *chain, size_t len,
+                                   uint32_t hash_size)
+{
+    const uint8_t *p = chain, *end = chain + len;
+    X509 *cert, *leaf = NULL;
+    EVP_PKEY *key;
+
+    /* Skip the SPDM header if the length field matches. */
+    if (len > SPDM_CERT_CHAIN_HDR_SIZE + hash_size &&
+        (chain[0] | (chain[1] << 8)) == len) {
+        p += SPDM_CERT_CHAIN_HDR_SIZE + hash_size;
+    }
+
+    while (p < end) {
+        cert = d2i_X509(NULL, &p, end - p);
+        if (!cert) {
+            printf("invalid certificate at offset %zu\n",
+                   (size_t)(p - chain));
+            X509_free(leaf);
+            return NULL;
+        }
+        X509_free(leaf);
+        leaf = cert;
+    }
+
+    if (!leaf) {
+        printf("empty certificate chain\n");
+        return NULL;
+    }
+
+    key = X509_get_pubkey(leaf);
+    X509_free(leaf);
+
+    return key;
+}
+
+void spdm_pubkey_free(spdm_pubkey_t *key)
+{
+    EVP_PKEY_free(key);
+}
+
+/*
+ * Split a chain into certificates, root side first, with the DER encoding
+ * of each. With hash_size 0 the root hash size is the one that matches the
+ * first certificate.
+ *
+ * Returns the number of certificates or -SPDM_CHAIN_* on failure.
+ */
+static int spdm_chain_parse(const uint8_t *chain, size_t len,
+                            uint32_t hash_size, X509 **certs,
+                            const uint8_t **der, size_t *der_len)
+{
+    static const uint32_t sizes[] = { 48, 64, 32 };
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    const uint8_t *p, *end = chain + len;
+    size_t hdr = 0;
+    int n = 0, i;
+
+    /* SPDM header if the length field matches. */
+    if (len > SPDM_CERT_CHAIN_HDR_SIZE &&
+        (chain[0] | (chain[1] << 8)) == len) {
+        for (i = 0; i < 3 && !hdr; i++) {
+            if (hash_size && hash_size != sizes[i]) {
+                continue;
+            }
+            if (len <= SPDM_CERT_CHAIN_HDR_SIZE + sizes[i]) {
+                continue;
+            }
+            der[0] = chain + SPDM_CERT_CHAIN_HDR_SIZE + sizes[i];
+            p = der[0];
+            certs[0] = d2i_X509(NULL, &p, end - p);
+            if (!certs[0]) {
+                continue;
+            }
+            X509_free(certs[0]);
+            if (spdm_verify_digest(sizes[i], der[0], p - der[0], digest) &&
+                !memcmp(digest, chain + SPDM_CERT_CHAIN_HDR_SIZE, sizes[i])) {
+                hdr = SPDM_CERT_CHAIN_HDR_SIZE + sizes[i];
+            } else if (hash_size) {
+                return -SPDM_CHAIN_ROOT_HASH;
+            }
+        }
+        if (!hdr) {
+            return -SPDM_CHAIN_ROOT_HASH;
+        }
+    }
+
+    for (p = chain + hdr; p < end; n++) {
+        if (n == SPDM_CHAIN_MAX_CERTS) {
+            break;
+        }
+        der[n] = p;
+        certs[n] = d2i_X509(NULL, &p, end - p);
+        if (!certs[n]) {
+            break;
+        }
+        der_len[n] = p - der[n];
+    }
+    if (p != end || !n) {
+        while (n--) {
+            X509_free(certs[n]);
+        }
+        return -SPDM_CHAIN_MALFORMED;
+    }
+
+    return n;
+}
+
+spdm_cert_cache_t *spdm_cert_cache_new(void)
+{
+    spdm_cert_cache_t *cache = calloc(1, sizeof(*cache));
+
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->store = X509_STORE_new();
+    if (!cache->store || pthread_rwlock_init(&cache->lock, NULL)) {
+        X509_STORE_free(cache->store);
+        free(cache);
+        return NULL;
+    }
+    /* Any root given is a trust anchor, self-signed or not. */
+    X509_STORE_set_flags(cache->store, X509_V_FLAG_PARTIAL_CHAIN);
+
+    return cache;
+}
+
+void spdm_cert_cache_free(spdm_cert_cache_t *cache)
+{
+    spdm_cert_entry_t *entry;
+    uint32_t i;
+
+    if (!cache) {
+        return;
+    }
+
+    for (i = 0; i < SPDM_CERT_CACHE_BUCKETS; i++) {
+        while ((entry = cache->buckets[i])) {
+            cache->buckets[i] = entry->next;
+            free(entry);
+        }
+    }
+    X509_STORE_free(cache->store);
+    pthread_rwlock_destroy(&cache->lock);
+    free(cache);
+}
+
+static spdm_cert_entry_t **spdm_cert_cache_bucket(spdm_cert_cache_t *cache,
+                                                  const uint8_t *digest)
+{
+    return &cache->buckets[(digest[0] | (digest[1] << 8)) %
+                           SPDM_CERT_CACHE_BUCKETS];
+}
+
+static bool spdm_cert_cache_find(spdm_cert_cache_t *cache,
+                                 const uint8_t *digest)
+{
+    spdm_cert_entry_t *entry;
+
+    pthread_rwlock_rdlock(&cache->lock);
+    entry = *spdm_cert_cache_bucket(cache, digest);
+    while (entry && memcmp(entry->digest, digest, sizeof(entry->digest))) {
+        entry = entry->next;
+    }
+    pthread_rwlock_unlock(&cache->lock);
+
+    return entry != NULL;
+}
+
+static void spdm_cert_cache_insert(spdm_cert_cache_t *cache,
+                                   const uint8_t *digest)
+{
+    spdm_cert_entry_t **bucket, *entry;
+
+    pthread_rwlock_wrlock(&cache->lock);
+    bucket = spdm_cert_cache_bucket(cache, digest);
+    for (entry = *bucket; entry; entry = entry->next) {
+        if (!memcmp(entry->digest, digest, sizeof(entry->digest))) {
+            break;
+        }
+    }
+    /* Another thread may have verified it meanwhile. */
+    if (!entry) {
+        entry = malloc(sizeof(*entry));
+        if (entry) {
+            memcpy(entry->digest, digest, sizeof(entry->digest));
+            entry->next = *bucket;
+            *bucket = entry;
+        }
+    }
+    pthread_rwlock_unlock(&cache->lock);
+}
+
+bool spdm_cert_cache_add_root(spdm_cert_cache_t *cache, const uint8_t *der,
+                              size_t len)
+{
+    const uint8_t *p = der;
+    X509 *cert;
+    bool result;
+
+    cert = d2i_X509(NULL, &p, len);
+    if (!cert) {
+        printf("invalid root certificate\n");
+        return false;
+    }
+
+    /* The store takes its own reference. */
+    result = X509_STORE_add_cert(cache->store, cert) == 1;
+    X509_free(cert);
+
+    return result;
+}
+
+void spdm_cert_cache_stats(spdm_cert_cache_t *cache, uint64_t *verified,
+                           uint64_t *hits)
+{
+    *verified = __atomic_load_n(&cache->verified, __ATOMIC_RELAXED);
+    *hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+}
+
+/* Map an X509_verify_cert() error to the SPDM_CHAIN_* reason. */
+static int spdm_chain_status(int error)
+{
+    switch (error) {
+    case X509_V_ERR_CERT_SIGNATURE_FAILURE:
+    case X509_V_ERR_UNABLE_TO_DECRYPT_CERT_SIGNATURE:
+    case X509_V_ERR_UNABLE_TO_DECODE_ISSUER_PUBLIC_KEY:
+        return SPDM_CHAIN_BAD_SIGNATURE;
+    case X509_V_ERR_CERT_NOT_YET_VALID:
+    case X509_V_ERR_CERT_HAS_EXPIRED:
+        return SPDM_CHAIN_EXPIRED;
+    case X509_V_ERR_INVALID_CA:
+        return SPDM_CHAIN_NOT_CA;
+    default:
+        return SPDM_CHAIN_UNTRUSTED;
+    }
+}
+
+/*
+ * Check the leaf against its issuer, whose chain was verified before: what
+ * X509_verify_cert() checks for the last certificate.
+ */
+static int spdm_leaf_verify(X509 *issuer, X509 *leaf)
+{
+    EVP_PKEY *key;
+    int result;
+
+    if (X509_check_issued(issuer, leaf) != X509_V_OK) {
+        return SPDM_CHAIN_UNTRUSTED;
+    }
+
+    key = X509_get0_pubkey(issuer);
+    if (!key) {
+        return SPDM_CHAIN_BAD_SIGNATURE;
+    }
+    result = X509_verify(leaf, key);
+    if (result != 1) {
+        return SPDM_CHAIN_BAD_SIGNATURE;
+    }
+
+    if (X509_cmp_current_time(X509_get0_notBefore(leaf)) >= 0 ||
+        X509_cmp_current_time(X509_get0_notAfter(leaf)) <= 0) {
+        return SPDM_CHAIN_EXPIRED;
+    }
+
+    return SPDM_CHAIN_OK;
+}
+
+int spdm_chain_verify(spdm_cert_cache_t *cache, const uint8_t *chain,
+                      size_t len, uint32_t hash_size, spdm_pubkey_t **key)
+{
+    uint8_t digest[SPDM_HASH_SHA384_SIZE];
+    X509 *certs[SPDM_CHAIN_MAX_CERTS];
+    const uint8_t *der[SPDM_CHAIN_MAX_CERTS];
+    size_t der_len[SPDM_CHAIN_MAX_CERTS];
+    STACK_OF(X509) *untrusted = NULL;
+    X509_STORE_CTX *ctx = NULL;
+    int n, i, status = SPDM_CHAIN_OK;
+    bool cached = false;
+
+    n = spdm_chain_parse(chain, len, hash_size, certs, der, der_len);
+    if (n < 0) {
+        return -n;
+    }
+
+    /*
+     * Cache key: the CA certificates, leaf and root hash header left out,
+     * so devices with their own leaves under the same CAs share an entry.
+     * A leaf issued straight by a trusted root has nothing to cache.
+     */
+    if (n > 1) {
+        if (spdm_hash(SPDM_HASH_SHA384_SIZE, der[0], der[n - 1] - der[0],
+                      digest)) {
+            status = SPDM_CHAIN_MALFORMED;
+            goto out;
+        }
+        cached = spdm_cert_cache_find(cache, digest);
+    }
+
+    if (cached) {
+        /* Verified before, only the validity periods can have changed. */
+        __atomic_fetch_add(&cache->hits, 1, __ATOMIC_RELAXED);
+        for (i = 0; i < n - 1; i++) {
+            if (X509_cmp_current_time(X509_get0_notAfter(certs[i])) <= 0) {
+                status = SPDM_CHAIN_EXPIRED;
+                goto out;
+            }
+        }
+        status = spdm_leaf_verify(certs[n - 2], certs[n - 1]);
+        if (status != SPDM_CHAIN_OK) {
+            goto out;
+        }
+    } else {
+        untrusted = sk_X509_new_null();
+        ctx = X509_STORE_CTX_new();
+        if (!untrusted || !ctx) {
+            status = SPDM_CHAIN_MALFORMED;
+            goto out;
+        }
+        for (i = 0; i < n - 1; i++) {
+            if (!sk_X509_push(untrusted, certs[i])) {
+                status = SPDM_CHAIN_MALFORMED;
+                goto out;
+            }
+        }
+        if (!X509_STORE_CTX_init(ctx, cache->store, certs[n - 1],
+                                 untrusted)) {
+            status = SPDM_CHAIN_MALFORMED;
+            goto out;
+        }
+
+        __atomic_fetch_add(&cache->verified, 1, __ATOMIC_RELAXED);
+        if (X509_verify_cert(ctx) != 1) {
+            status = spdm_chain_status(X509_STORE_CTX_get_error(ctx));
+            goto out;
+        }
+        if (n > 1) {
+            spdm_cert_cache_insert(cache, digest);
+        }
+    }
+
+    if (key) {
+        *key = X509_get_pubkey(certs[n - 1]);
+        if (!*key) {
+            status = SPDM_CHAIN_MALFORMED;
+        }
+    }
+
+out:
+    X509_STORE_CTX_free(ctx);
+    sk_X509_free(untrusted);
+    for (i = 0; i < n; i++) {
+        X509_free(certs[i]);
+    }
+    return status;
+}
+
+const char *spdm_chain_strerror(int status)
+{
+    switch (status) {
+    case SPDM_CHAIN_OK:
+        return "ok";
+    case SPDM_CHAIN_MALFORMED:
+        return "malformed certificate chain";
+    case SPDM_CHAIN_ROOT_HASH:
+        return "root hash mismatch";
+    case SPDM_CHAIN_UNTRUSTED:
+        return "untrusted root";
+    case SPDM_CHAIN_BAD_SIGNATURE:
+        return "bad certificate signature";
+    case SPDM_CHAIN_EXPIRED:
+        return "certificate expired or not yet valid";
+    case SPDM_CHAIN_NOT_CA:
+        return "issuer is not a CA";
+    default:
+        return "unknown error";
+    }
+}
+
+bool spdm_verify_meas_signature(spdm_pubkey_t *key, uint8_t version,
+                                uint32_t base_hash_algo,
+                                uint32_t base_asym_algo,
+                                const uint8_t *transcript,
+                                uint32_t transcript_len,
+                                const uint8_t *sig, uint32_t sig_len)
+{
+    uint8_t msg[SPDM_SIGNING_CONTEXT_SIZE + EVP_MAX_MD_SIZE];
+    uint8_t digest[EVP_MAX_MD_SIZE], *der = NULL;
+    char prefix[SPDM_SIGNING_PREFIX_SIZE + 1];
+    uint32_t digest_len = spdm_hash_size(base_hash_algo);
+    EVP_PKEY_CTX *ctx = NULL;
+    ECDSA_SIG *ecdsa = NULL;
+    BIGNUM *r, *s;
+    bool result = false;
+    uint32_t i, off;
+    int der_len;
+
+    if (!digest_len || !key ||
+        sig_len != spdm_asym_signature_size(base_asym_algo) ||
+        EVP_PKEY_base_id(key) != EVP_PKEY_EC) {
+        printf("unsupported signature algorithm\n");
+        return false;
+    }
+
+    if (!spdm_verify_digest(digest_len, transcript, transcript_len, digest)) {
+        return false;
+    }
+
+    /*
+     * From SPDM 1.2 on, the signed message is the signing context followed
+     * by the transcript hash, and ECDSA hashes it once more.
+     */
+    if (version >= SPDM_VERSION_12) {
+        memcpy(prefix, "dmtf-spdm-v1.2.*", sizeof(prefix));
+        prefix[11] = '0' + (version >> 4);
+        prefix[13] = '0' + (version & 0xF);
+        for (i = 0; i < 4; i++) {
+            memcpy(msg + i * SPDM_SIGNING_PREFIX_SIZE, prefix,
+                   SPDM_SIGNING_PREFIX_SIZE);
+        }
+        off = SPDM_SIGNING_CONTEXT_SIZE - strlen(SPDM_MEAS_SIGNING_CONTEXT);
+        memset(msg + 4 * SPDM_SIGNING_PREFIX_SIZE, 0,
+               off - 4 * SPDM_SIGNING_PREFIX_SIZE);
+        memcpy(msg + off, SPDM_MEAS_SIGNING_CONTEXT,
+               strlen(SPDM_MEAS_SIGNING_CONTEXT));
+        memcpy(msg + SPDM_SIGNING_CONTEXT_SIZE, digest, digest_len);
+        if (!spdm_verify_digest(digest_len, msg,
+                                SPDM_SIGNING_CONTEXT_SIZE + digest_len,
+                                digest)) {
+            return false;
+        }
+    }
+
+    /* SPDM carries ECDSA signatures as raw r || s. */
+    ecdsa = ECDSA_SIG_new();
+    r = BN_bin2bn(sig, sig_len / 2, NULL);
+    s = BN_bin2bn(sig + sig_len / 2, sig_len / 2, NULL);
+    if (!ecdsa || !r || !s || !ECDSA_SIG_set0(ecdsa, r, s)) {
+        BN_free(r);
+        BN_free(s);
+        goto out;
+    }
+    der_len = i2d_ECDSA_SIG(ecdsa, &der);
+    if (der_len <= 0) {
+        goto out;
+    }
+
+    ctx = EVP_PKEY_CTX_new(key, NULL);
+    if (ctx && EVP_PKEY_verify_init(ctx) == 1 &&
+        EVP_PKEY_verify(ctx, der, der_len, digest, digest_len) == 1) {
+        result = true;
+    }
+
+out:
+    EVP_PKEY_CTX_free(ctx);
+    OPENSSL_free(der);
+    ECDSA_SIG_free(ecdsa);
+    return result;
+}
+
+uint32_t spdm_meas_hash_size(uint32_t meas_hash_algo)
+{
+    switch (meas_hash_algo) {
+    case SPDM_MEAS_HASH_SHA_256:
+        return 32;
+    case SPDM_MEAS_HASH_SHA_384:
+        return SPDM_HASH_SHA384_SIZE;
+    case SPDM_MEAS_HASH_SHA_512:
+        return SPDM_HASH_SHA512_SIZE;
+    default:
+        return 0;
+    }
+}
+
+bool spdm_meas_block_signed(const spdm_meas_block_t *blk,
+                            const spdm_meas_block_t *sig,
+                            uint32_t meas_hash_algo)
+{
+    uint32_t digest_size = spdm_meas_hash_size(meas_hash_algo);
+    uint8_t digest[SPDM_HASH_SHA512_SIZE];
+
+    if (!blk->raw || !sig->raw || blk->index != sig->index) {
+        return false;
+    }
+    if (blk->size == sig->size &&
+        !memcmp(blk->raw, sig->raw, spdm_meas_block_size(blk))) {
+        return true;
+    }
+
+    return digest_size && spdm_meas_is_digest(sig) &&
+           sig->value_size == digest_size && blk->value &&
+           (blk->value_type & SPDM_MEAS_TYPE_RAW_BIT_STREAM) &&
+           (blk->value_type & SPDM_MEAS_TYPE_MASK) == sig->value_type &&
+           spdm_verify_digest(digest_size, blk->value, blk->value_size,
+                              digest) &&
+           !memcmp(digest, sig->value, digest_size);
+}
+
+static void spdm_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t spdm_get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t spdm_evidence_encode(const spdm_evidence_t *ev, uint8_t *buf,
+                            size_t size)
+{
+    size_t len = SPDM_EVIDENCE_HDR_SIZE + ev->transcript_len +
+                 ev->signature_len;
+
+    if (len > size || ev->record < ev->transcript ||
+        ev->record + ev->record_len > ev->transcript + ev->transcript_len) {
+        return 0;
+    }
+
+    spdm_put32(buf, SPDM_EVIDENCE_MAGIC);
+    buf[4] = ev->version;
+    buf[5] = ev->slot;
+    buf[6] = 0;
+    buf[7] = 0;
+    spdm_put32(buf + 8, ev->meas_hash_algo);
+    spdm_put32(buf + 12, ev->base_hash_algo);
+    spdm_put32(buf + 16, ev->base_asym_algo);
+    spdm_put32(buf + 20, ev->transcript_len);
+    spdm_put32(buf + 24, ev->record - ev->transcript);
+    spdm_put32(buf + 28, ev->record_len);
+    spdm_put32(buf + 32, ev->signature_len);
+    memcpy(buf + SPDM_EVIDENCE_HDR_SIZE, ev->transcript, ev->transcript_len);
+    memcpy(buf + SPDM_EVIDENCE_HDR_SIZE + ev->transcript_len, ev->signature,
+           ev->signature_len);
+
+    return len;
+}
+
+int spdm_evidence_parse(const uint8_t *buf, size_t len, spdm_evidence_t *ev)
+{
+    uint32_t record_offset;
+
+    if (len < SPDM_EVIDENCE_HDR_SIZE ||
+        spdm_get32(buf) != SPDM_EVIDENCE_MAGIC) {
+        return -1;
+    }
+
+    ev->version = buf[4];
+    ev->slot = buf[5];
+    ev->meas_hash_algo = spdm_get32(buf + 8);
+    ev->base_hash_algo = spdm_get32(buf + 12);
+    ev->base_asym_algo = spdm_get32(buf + 16);
+    ev->transcript_len = spdm_get32(buf + 20);
+    record_offset = spdm_get32(buf + 24);
+    ev->record_len = spdm_get32(buf + 28);
+    ev->signature_len = spdm_get32(buf + 32);
+
+    if ((uint64_t)SPDM_EVIDENCE_HDR_SIZE + ev->transcript_len +
+        ev->signature_len != len ||
+        (uint64_t)record_offset + ev->record_len > ev->transcript_len) {
+        return -1;
+    }
+
+    ev->transcript = buf + SPDM_EVIDENCE_HDR_SIZE;
+    ev->record = ev->transcript + record_offset;
+    ev->signature = ev->transcript + ev->transcript_len;
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/* SPDX-License-Identifier: GPL-2.0-only or BSD-3-Clause */
+
+/* SPDM evidence verification header file.
+ *
+ * Copyright (c) 2023 NVIDIA Corporation.
+ */
+
+#ifndef _SPDM_VERIFY_H_
+#define _SPDM_VERIFY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "spdm_meas.h"
+
+/* Opaque public key handle (EVP_PKEY). */
+typedef struct evp_pkey_st spdm_pubkey_t;
+
+/*
+ * Get the leaf public key from a certificate chain
+ *
+ * chain: certificate chain as saved in device_cert_chain_N.bin (SPDM cert
+ *        chain header, root hash, then DER certificates) or plain
+ *        concatenated DER certificates
+ * len: certificate chain length
+ * hash_size: size of the root hash in the SPDM header
+ *
+ * Returns the key, to be released with spdm_pubkey_free(), or NULL.
+ */
+spdm_pubkey_t *spdm_chain_leaf_key(const uint8_t *chain, size_t len,
+                                   uint32_t hash_size);
+
+void spdm_pubkey_free(spdm_pubkey_t *key);
+
+/* Certificate chain verification results. */
+#define SPDM_CHAIN_OK               0
+#define SPDM_CHAIN_MALFORMED        1   /* not a certificate chain */
+#define SPDM_CHAIN_ROOT_HASH        2   /* root hash doesn't match */
+#define SPDM_CHAIN_UNTRUSTED        3   /* no path to a trusted root */
+#define SPDM_CHAIN_BAD_SIGNATURE    4   /* certificate signature invalid */
+#define SPDM_CHAIN_EXPIRED          5   /* certificate not valid now */
+#define SPDM_CHAIN_NOT_CA           6   /* issuer is not a CA */
+
+/*
+ * Trusted roots and chains already validated against them
+ *
+ * Chains are validated by OpenSSL against an X509_STORE of the roots, and
+ * the CA part of the good ones, every certificate but the leaf, is
+ * remembered by its SHA-384. A chain under known CAs only has the leaf
+ * checked against its issuer, and the CA validity periods, so a fleet of
+ * devices with their own leaves verifies the shared CAs once. The cache
+ * may be shared by threads verifying chains concurrently.
+ */
+typedef struct spdm_cert_cache spdm_cert_cache_t;
+
+spdm_cert_cache_t *spdm_cert_cache_new(void);
+void spdm_cert_cache_free(spdm_cert_cache_t *cache);
+
+/*
+ * Add a trusted root certificate
+ *
+ * der: DER encoded certificate, such as certs/opn_root_cert.der
+ *
+ * Returns true on success.
+ */
+bool spdm_cert_cache_add_root(spdm_cert_cache_t *cache, const uint8_t *der,
+                              size_t len);
+
+/* Number of chains verified and of cache hits so far. */
+void spdm_cert_cache_stats(spdm_cert_cache_t *cache, uint64_t *verified,
+                           uint64_t *hits);
+
+/*
+ * Verify a certificate chain against the trusted roots
+ *
+ * chain: certificate chain as for spdm_chain_leaf_key(), root side first
+ * hash_size: size of the root hash in the SPDM header, or 0 to find out
+ *            from the chain itself
+ * key: set to the leaf public key on success if not NULL
+ *
+ * Returns SPDM_CHAIN_OK or the SPDM_CHAIN_* reason of the failure.
+ */
+int spdm_chain_verify(spdm_cert_cache_t *cache, const uint8_t *chain,
+                      size_t len, uint32_t hash_size, spdm_pubkey_t **key);
+
+const char *spdm_chain_strerror(int status);
+
+/*
+ * Verify the signature of a MEASUREMENTS response
+ *
+ * key: responder public key
+ * version: negotiated SPDM version
+ * base_hash_algo: negotiated BaseHashAlgo
+ * base_asym_algo: negotiated BaseAsymAlgo
+ * transcript: L1 transcript, signature excluded
+ * sig: signature (raw r || s for ECDSA)
+ *
+ * Returns true if the signature matches.
+ */
+bool spdm_verify_meas_signature(spdm_pubkey_t *key, uint8_t version,
+                                uint32_t base_hash_algo,
+                                uint32_t base_asym_algo,
+                                const uint8_t *transcript,
+                                uint32_t transcript_len,
+                                const uint8_t *sig, uint32_t sig_len);
+
+/* Get the digest size for a MeasurementHashAlgo value, or 0. */
+uint32_t spdm_meas_hash_size(uint32_t meas_hash_algo);
+
+/*
+ * Check a measurement block against the signed block of its index
+ *
+ * The block is covered if it's the signed block itself, or the raw bit
+ * stream whose digest is the signed block.
+ *
+ * blk: block to check
+ * sig: block of the same index in the signed record
+ * meas_hash_algo: negotiated MeasurementHashAlgo
+ *
+ * Returns true if the block is covered.
+ */
+bool spdm_meas_block_signed(const spdm_meas_block_t *blk,
+                            const spdm_meas_block_t *sig,
+                            uint32_t meas_hash_algo);
+
+/*
+ * Signed measurement evidence, saved for offline verification
+ *
+ * File layout, little endian: magic, version, slot, 2 reserved bytes,
+ * MeasurementHashAlgo, BaseHashAlgo, BaseAsymAlgo, transcript length,
+ * record offset and length in the transcript, signature length; then the
+ * L1 transcript and the signature.
+ */
+#define SPDM_EVIDENCE_MAGIC     0x45445053U     /* "SPDE" */
+#define SPDM_EVIDENCE_HDR_SIZE  36U
+
+typedef struct spdm_evidence {
+    uint8_t version;            /* negotiated SPDM version */
+    uint8_t slot;               /* certificate slot of the signing key */
+    uint32_t meas_hash_algo;    /* MeasurementHashAlgo */
+    uint32_t base_hash_algo;    /* BaseHashAlgo */
+    uint32_t base_asym_algo;    /* BaseAsymAlgo */
+    const uint8_t *transcript;  /* L1 transcript, signature excluded */
+    uint32_t transcript_len;
+    const uint8_t *record;      /* signed measurement record, in transcript */
+    uint32_t record_len;
+    const uint8_t *signature;   /* signature */
+    uint32_t signature_len;
+} spdm_evidence_t;
+
+/*
+ * Serialize evidence
+ *
+ * Returns the encoded length, or 0 if it doesn't fit in size bytes.
+ */
+size_t spdm_evidence_encode(const spdm_evidence_t *ev, uint8_t *buf,
+                            size_t size);
+
+/*
+ * Parse evidence, pointers in ev refer to buf
+ *
+ * Returns 0 on success or -1 if malformed.
+ */
+int spdm_evidence_parse(const uint8_t *buf, size_t len, spdm_evidence_t *ev);
+
+#endif /* _SPDM_VERIFY_H_ */
@@ -0,0 +1,561 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Offline batch verification of collected SPDM dumps.
+ *
+ * Every device directory holds what spdm_requester_emu / spdm-meas-sync
+ * saved for one device:
+ *   device_cert_chain_<slot>.bin   certificate chains
+ *   device_measurement_sig.bin     signed measurement exchange
+ *   device_measurement.bin         measurement record (optional)
+ *
+ * Chains are validated against the given root certificates, the signature
+ * of the measurement exchange is checked with the leaf key of its slot,
+ * and the measurement record is checked against the signed one. Devices
+ * are spread over a work-stealing thread pool; the CA certificates shared
+ * by many devices are verified once and then cached.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include "spdm_hash.h"
+#include "spdm_meas.h"
+#include "spdm_verify.h"
+
+#define CHAIN_FILE      "device_cert_chain_%u.bin"
+#define MEAS_FILE       "device_measurement.bin"
+#define SIG_FILE        "device_measurement_sig.bin"
+
+#define MAX_SLOTS       8
+#define REPORT_SIZE     1024
+
+/* One device directory and its verification report. */
+typedef struct device {
+    char *path;
+    bool pass;
+    size_t report_len;
+    char report[REPORT_SIZE];
+} device_t;
+
+/*
+ * Worker with its own range of devices, [head, tail) packed in one word.
+ * The owner takes from the head, idle workers steal half from the tail.
+ */
+typedef struct worker {
+    pthread_t thread;
+    uint64_t range;
+    uint32_t id;
+} worker_t;
+
+static spdm_cert_cache_t *m_cache;
+static device_t *m_devices;
+static uint32_t m_num_devices;
+static worker_t *m_workers;
+static uint32_t m_num_workers;
+static bool m_verbose;
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    uint8_t *buf;
+    long size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = malloc(size ? size : 1);
+    if (buf && fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+
+    *len = size;
+    return buf;
+}
+
+static void report(device_t *dev, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (dev->report_len >= REPORT_SIZE - 1) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    n = vsnprintf(dev->report + dev->report_len,
+                  REPORT_SIZE - dev->report_len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0) {
+        dev->report_len += n;
+        if (dev->report_len >= REPORT_SIZE) {
+            dev->report_len = REPORT_SIZE - 1;
+        }
+    }
+}
+
+/* Raw form of a signed digest: checked by hashing its value. */
+static bool raw_of_digest(const spdm_meas_block_t *blk,
+                          const spdm_meas_block_t *sig, uint32_t digest_size)
+{
+    return digest_size && spdm_meas_is_digest(sig) &&
+           !spdm_meas_is_digest(blk) &&
+           (blk->value_type & SPDM_MEAS_TYPE_MASK) == sig->value_type &&
+           sig->value_size == digest_size;
+}
+
+/*
+ * Every block of the record must be covered by the signed block of its
+ * index: identical, or the raw form of the signed digest. Raw values of a
+ * record are hashed together with spdm_hash_mb().
+ */
+static bool verify_record(device_t *dev, const spdm_evidence_t *ev,
+                          const uint8_t *rec, size_t len)
+{
+    static __thread spdm_meas_block_t sig[256], blocks[256];
+    static __thread uint8_t digests[256][SPDM_HASH_SHA512_SIZE];
+    uint32_t digest_size = spdm_meas_hash_size(ev->meas_hash_algo);
+    const uint8_t *data[256];
+    uint8_t *digest[256];
+    unsigned int digest_len;
+    size_t data_len[256];
+    int i, n, nraw = 0, raw[256], bad = 0;
+
+    if (spdm_meas_index(ev->record, ev->record_len, sig) < 0 ||
+        (n = spdm_meas_index(rec, len, blocks)) < 0) {
+        report(dev, "  record: malformed\n");
+        return false;
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (!blocks[i].raw && !sig[i].raw) {
+            continue;
+        }
+        if (!blocks[i].raw) {
+            report(dev, "  record: index %d missing\n", i);
+            bad++;
+        } else if (!sig[i].raw) {
+            report(dev, "  record: index %d not signed\n", i);
+            bad++;
+        } else if (blocks[i].size == sig[i].size &&
+                   !memcmp(blocks[i].raw, sig[i].raw,
+                           spdm_meas_block_size(&blocks[i]))) {
+            continue;
+        } else if (raw_of_digest(&blocks[i], &sig[i], digest_size)) {
+            raw[nraw] = i;
+            data[nraw] = blocks[i].value;
+            data_len[nraw] = blocks[i].value_size;
+            digest[nraw] = digests[nraw];
+            nraw++;
+        } else {
+            report(dev, "  record: index %d mismatch\n", i);
+            bad++;
+        }
+    }
+
+    if (digest_size == 32) {
+        for (i = 0; i < nraw; i++) {
+            EVP_Digest(data[i], data_len[i], digest[i], &digest_len,
+                       EVP_sha256(), NULL);
+        }
+    } else if (nraw) {
+        spdm_hash_mb(digest_size, nraw, data, data_len, digest);
+    }
+    for (i = 0; i < nraw; i++) {
+        if (memcmp(digest[i], sig[raw[i]].value, digest_size)) {
+            report(dev, "  record: index %d mismatch\n", raw[i]);
+            bad++;
+        }
+    }
+
+    if (!bad && m_verbose) {
+        report(dev, "  record: %d blocks ok\n", n);
+    }
+
+    return !bad;
+}
+
+static void verify_device(device_t *dev)
+{
+    spdm_pubkey_t *keys[MAX_SLOTS] = { NULL };
+    uint8_t *chain, *sig_buf = NULL, *rec = NULL;
+    size_t chain_len, sig_len, rec_len;
+    uint32_t hash_size = 0, slot, nchains = 0;
+    char path[PATH_MAX];
+    spdm_evidence_t ev;
+    bool has_ev = false;
+    int status;
+
+    dev->pass = true;
+
+    snprintf(path, sizeof(path), "%s/%s", dev->path, SIG_FILE);
+    sig_buf = read_file(path, &sig_len);
+    if (sig_buf) {
+        if (spdm_evidence_parse(sig_buf, sig_len, &ev)) {
+            report(dev, "  signature: malformed %s\n", SIG_FILE);
+            dev->pass = false;
+        } else {
+            has_ev = true;
+            hash_size = spdm_hash_size(ev.base_hash_algo);
+        }
+    }
+
+    for (slot = 0; slot < MAX_SLOTS; slot++) {
+        snprintf(path, sizeof(path), "%s/" CHAIN_FILE, dev->path, slot);
+        chain = read_file(path, &chain_len);
+        if (!chain) {
+            continue;
+        }
+        nchains++;
+
+        status = spdm_chain_verify(m_cache, chain, chain_len, hash_size,
+                                   &keys[slot]);
+        free(chain);
+        if (status != SPDM_CHAIN_OK) {
+            report(dev, "  slot %u: %s\n", slot, spdm_chain_strerror(status));
+            dev->pass = false;
+        } else if (m_verbose) {
+            report(dev, "  slot %u: chain ok\n", slot);
+        }
+    }
+    if (!nchains) {
+        report(dev, "  no certificate chain\n");
+        dev->pass = false;
+    }
+
+    /* Unsigned evidence proves nothing. */
+    if (!has_ev) {
+        if (!sig_buf) {
+            report(dev, "  signature: no %s\n", SIG_FILE);
+            dev->pass = false;
+        }
+        goto out;
+    }
+
+    if (ev.slot >= MAX_SLOTS || !keys[ev.slot]) {
+        report(dev, "  signature: no valid chain for slot %u\n", ev.slot);
+        dev->pass = false;
+        goto out;
+    }
+    if (!spdm_verify_meas_signature(keys[ev.slot], ev.version,
+                                    ev.base_hash_algo, ev.base_asym_algo,
+                                    ev.transcript, ev.transcript_len,
+                                    ev.signature, ev.signature_len)) {
+        report(dev, "  signature: FAIL\n");
+        dev->pass = false;
+        goto out;
+    }
+    if (m_verbose) {
+        report(dev, "  signature: ok\n");
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dev->path, MEAS_FILE);
+    rec = read_file(path, &rec_len);
+    if (rec && !verify_record(dev, &ev, rec, rec_len)) {
+        dev->pass = false;
+    }
+
+out:
+    for (slot = 0; slot < MAX_SLOTS; slot++) {
+        spdm_pubkey_free(keys[slot]);
+    }
+    free(sig_buf);
+    free(rec);
+}
+
+static uint64_t make_range(uint32_t head, uint32_t tail)
+{
+    return ((uint64_t)head << 32) | tail;
+}
+
+/* Take the next device of the worker's own range. */
+static bool pop_device(worker_t *w, uint32_t *dev)
+{
+    uint64_t range = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+    uint32_t head, tail;
+
+    do {
+        head = range >> 32;
+        tail = range;
+        if (head >= tail) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&w->range, &range,
+                                          make_range(head + 1, tail), true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+
+    *dev = head;
+    return true;
+}
+
+/*
+ * Steal the back half of a victim's range into our own, which is empty.
+ * Nobody else can take from an empty range, so it is simply stored.
+ */
+static bool steal_devices(worker_t *w, worker_t *victim)
+{
+    uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+    uint32_t head, tail, mid;
+
+    do {
+        head = range >> 32;
+        tail = range;
+        if (head >= tail) {
+            return false;
+        }
+        mid = tail - (tail - head + 1) / 2;
+    } while (!__atomic_compare_exchange_n(&victim->range, &range,
+                                          make_range(head, mid), true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE));
+
+    __atomic_store_n(&w->range, make_range(mid, tail), __ATOMIC_RELEASE);
+    return true;
+}
+
+static void *verify_worker(void *arg)
+{
+    worker_t *w = arg;
+    uint32_t dev, i;
+    bool stolen;
+
+    for (;;) {
+        while (pop_device(w, &dev)) {
+            verify_device(&m_devices[dev]);
+        }
+
+        /* Devices are never added, so one empty round means done. */
+        stolen = false;
+        for (i = 1; i < m_num_workers && !stolen; i++) {
+            stolen = steal_devices(w, &m_workers[(w->id + i) %
+                                                 m_num_workers]);
+        }
+        if (!stolen) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static bool add_device(const char *path)
+{
+    device_t *devices;
+
+    if (!(m_num_devices & (m_num_devices + 1))) {
+        devices = realloc(m_devices, (m_num_devices * 2 + 1) *
+                          sizeof(*devices));
+        if (!devices) {
+            return false;
+        }
+        m_devices = devices;
+    }
+
+    memset(&m_devices[m_num_devices], 0, sizeof(*m_devices));
+    m_devices[m_num_devices].path = strdup(path);
+    if (!m_devices[m_num_devices].path) {
+        return false;
+    }
+    m_num_devices++;
+
+    return true;
+}
+
+static int compare_devices(const void *a, const void *b)
+{
+    return strcmp(((const device_t *)a)->path, ((const device_t *)b)->path);
+}
+
+static bool is_device_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    uint32_t slot;
+
+    for (slot = 0; slot < MAX_SLOTS; slot++) {
+        snprintf(path, sizeof(path), "%s/" CHAIN_FILE, dir, slot);
+        if (!stat(path, &st)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* A dump directory is either a device directory or holds device ones. */
+static bool scan_dir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    DIR *d;
+
+    if (is_device_dir(dir)) {
+        return add_device(dir);
+    }
+
+    d = opendir(dir);
+    if (!d) {
+        printf("%s: %m\n", dir);
+        return false;
+    }
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (!stat(path, &st) && S_ISDIR(st.st_mode) && is_device_dir(path) &&
+            !add_device(path)) {
+            closedir(d);
+            printf("out of memory\n");
+            return false;
+        }
+    }
+    closedir(d);
+
+    return true;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s -r <root.der> [-r ...] [options] <dump dir> ...\n"
+           "  -r <file>  trusted root certificate, DER\n"
+           "             (e.g. certs/opn_root_cert.der)\n"
+           "  -j <n>     number of worker threads (default: online CPUs)\n"
+           "  -v         report every check, not only failures\n",
+           prog);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t i, nthreads, npass = 0, per_worker;
+    uint64_t verified, hits;
+    uint8_t *der;
+    size_t der_len;
+    bool has_root = false;
+    int opt;
+
+    m_cache = spdm_cert_cache_new();
+    if (!m_cache) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    while ((opt = getopt(argc, argv, "r:j:vh")) != -1) {
+        switch (opt) {
+        case 'r':
+            der = read_file(optarg, &der_len);
+            if (!der) {
+                printf("%s: %m\n", optarg);
+                return 1;
+            }
+            if (!spdm_cert_cache_add_root(m_cache, der, der_len)) {
+                printf("%s: not a DER certificate\n", optarg);
+                return 1;
+            }
+            free(der);
+            has_root = true;
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'v':
+            m_verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!has_root || optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (; optind < argc; optind++) {
+        if (!scan_dir(argv[optind])) {
+            return 1;
+        }
+    }
+    if (!m_num_devices) {
+        printf("no device dumps found\n");
+        return 1;
+    }
+    qsort(m_devices, m_num_devices, sizeof(*m_devices), compare_devices);
+
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+    if (nthreads > m_num_devices) {
+        nthreads = m_num_devices;
+    }
+
+    /* Deal contiguous ranges, stealing evens out the slow ones. */
+    m_workers = calloc(nthreads, sizeof(*m_workers));
+    if (!m_workers) {
+        printf("out of memory\n");
+        return 1;
+    }
+    m_num_workers = nthreads;
+    per_worker = m_num_devices / nthreads;
+    for (i = 0; i < nthreads; i++) {
+        m_workers[i].id = i;
+        m_workers[i].range = make_range(i * per_worker,
+                                        i == nthreads - 1 ? m_num_devices :
+                                        (i + 1) * per_worker);
+    }
+
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&m_workers[i].thread, NULL, verify_worker,
+                           &m_workers[i])) {
+            printf("pthread_create failed\n");
+            return 1;
+        }
+    }
+    verify_worker(&m_workers[0]);
+    for (i = 1; i < nthreads; i++) {
+        pthread_join(m_workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < m_num_devices; i++) {
+        printf("%s: %s\n%s", m_devices[i].path,
+               m_devices[i].pass ? "PASS" : "FAIL", m_devices[i].report);
+        npass += m_devices[i].pass;
+        free(m_devices[i].path);
+    }
+
+    if (m_verbose) {
+        printf("sha-384/512: %s\n", spdm_hash_impl());
+    }
+    spdm_cert_cache_stats(m_cache, &verified, &hits);
+    printf("%u of %u devices passed, %lu chains verified, "
+           "%lu under cached CAs\n", npass, m_num_devices,
+           (unsigned long)verified, (unsigned long)hits);
+
+    spdm_cert_cache_free(m_cache);
+    free(m_workers);
+    free(m_devices);
+    return npass == m_num_devices ? 0 : 1;
+}
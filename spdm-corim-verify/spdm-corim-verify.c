@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Check SPDM measurement records against CoRIM reference values.
+ *
+ * Reference values are loaded once into a hash index; each measurement
+ * record (device_measurement.bin) is then checked block by block straight
+ * from the binary format, without converting it to json.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spdm_corim.h"
+#include "spdm_meas.h"
+
+static spdm_corim_t m_corim;
+static int m_alg_id;
+static bool m_verbose;
+
+/*
+ * Check a record against the reference values of one environment. Reports
+ * failures if 'path' is set. Returns the number of failures.
+ */
+static uint32_t check_env(const uint8_t *rec, size_t size, uint32_t env,
+                          const char *path, uint32_t *matched,
+                          uint32_t *unchecked)
+{
+    bool seen[256] = { false };
+    uint32_t failed = 0;
+    spdm_meas_block_t blk;
+    size_t offset = 0;
+    int i;
+
+    *matched = *unchecked = 0;
+    while (spdm_meas_next(rec, size, &offset, &blk) > 0) {
+        seen[blk.index] = true;
+        switch (spdm_corim_match(&m_corim, env, &blk, m_alg_id)) {
+        case SPDM_CORIM_MATCH:
+            (*matched)++;
+            if (path && m_verbose) {
+                printf("%s: index %u match\n", path, blk.index);
+            }
+            break;
+        case SPDM_CORIM_MISMATCH:
+            if (path) {
+                printf("%s: index %u mismatch\n", path, blk.index);
+            }
+            failed++;
+            break;
+        default:
+            (*unchecked)++;
+            if (path && m_verbose) {
+                printf("%s: index %u no reference value\n", path, blk.index);
+            }
+            break;
+        }
+    }
+
+    /* Every index with a reference value must be measured. */
+    for (i = 0; i < 256; i++) {
+        if (!seen[i] && spdm_corim_has_ref(&m_corim, env, i)) {
+            if (path) {
+                printf("%s: index %d missing\n", path, i);
+            }
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+/*
+ * Check one measurement record. It must match all the reference values of
+ * one environment; references of different environments aren't mixed.
+ * Returns true if it matches.
+ */
+static bool verify_file(const char *path)
+{
+    uint32_t matched, unchecked, failed, best_failed = UINT32_MAX, env;
+    uint32_t best = 0;
+    spdm_meas_block_t blk;
+    size_t offset = 0;
+    uint8_t *rec = NULL;
+    struct stat st;
+    int fd, rc;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        printf("%s: %m\n", path);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+    if (st.st_size) {
+        rec = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (rec == MAP_FAILED) {
+            printf("%s: mmap - %m\n", path);
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+
+    do {
+        rc = spdm_meas_next(rec, st.st_size, &offset, &blk);
+    } while (rc > 0);
+    if (rc) {
+        printf("%s: malformed measurement record\n", path);
+        best_failed = 1;
+        goto out;
+    }
+
+    for (env = 0; env < m_corim.nenvs && best_failed; env++) {
+        failed = check_env(rec, st.st_size, env, NULL, &matched, &unchecked);
+        if (failed < best_failed) {
+            best_failed = failed;
+            best = env;
+        }
+    }
+
+    /* Report against the matching environment, or the closest one. */
+    check_env(rec, st.st_size, best, path, &matched, &unchecked);
+    printf("%s: %s %s %s (%u matched, %u without reference)\n", path,
+           best_failed ? "FAIL" : "PASS", best_failed ? "closest to" : "as",
+           m_corim.envs[best].name, matched, unchecked);
+
+out:
+    if (rec) {
+        munmap(rec, st.st_size);
+    }
+    return !best_failed;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s -r <corim> [options] <device_measurement.bin>...\n"
+           "  -r <file>  CoRIM / CoMID reference values (CBOR), repeatable\n"
+           "  -a <alg>   digest algorithm: sha256, sha384, sha512, sha3_256,\n"
+           "             sha3_384, sha3_512 (default: by digest size)\n"
+           "  -v         report every index\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, i, nref = 0, failed = 0;
+
+    while ((opt = getopt(argc, argv, "r:a:vh")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (spdm_corim_load(&m_corim, optarg)) {
+                return 1;
+            }
+            nref++;
+            break;
+        case 'a':
+            m_alg_id = spdm_meas_alg_id(optarg);
+            if (!m_alg_id) {
+                printf("Unknown algorithm %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'v':
+            m_verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!nref || optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!m_corim.nenvs) {
+        printf("no reference values loaded\n");
+        return 1;
+    }
+
+    for (i = optind; i < argc; i++) {
+        if (!verify_file(argv[i])) {
+            failed++;
+        }
+    }
+
+    if (argc - optind > 1) {
+        printf("%d of %d records failed\n", failed, argc - optind);
+    }
+
+    spdm_corim_free(&m_corim);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,353 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Convert SPDM measurement records to CoRIM evidence json.
+ *
+ * Native equivalent of 'SpdmMeasurement.py meas_to_json'. Each input file
+ * (device_measurement.bin) is memory-mapped and streamed to json with the
+ * same schema:
+ *
+ *   {"evidences": [{"evidence": {"index": N, "digest": [alg, "hex"]}},
+ *                  {"evidence": {"index": N, "svn": N}},
+ *                  {"evidence": {"index": N, "raw": "hex"}}]}
+ *
+ * Files are converted in parallel by a pool of worker threads.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "spdm_meas.h"
+
+#define OUTPUT_BUFFER_SIZE (256 * 1024)
+#define MAX_THREADS 256
+
+/* Conversion job shared by all worker threads. */
+typedef struct meas_json_job {
+    char **inputs;          /* input files */
+    char **outputs;         /* output file of each input */
+    int count;              /* number of input files */
+    const char *output;     /* output file for a single input, "-" = stdout */
+    const char *out_dir;    /* output directory, NULL = next to the input */
+    int alg_id;             /* CoRIM hash algorithm id, 0 = by digest size */
+    int next;               /* next input to convert */
+    int failed;             /* number of failed conversions */
+} meas_json_job_t;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void write_hex(FILE *fp, const uint8_t *buf, size_t len)
+{
+    char hex[128];
+    size_t i, n = 0;
+
+    for (i = 0; i < len; i++) {
+        hex[n++] = hex_digits[buf[i] >> 4];
+        hex[n++] = hex_digits[buf[i] & 0xf];
+        if (n == sizeof(hex)) {
+            fwrite(hex, 1, n, fp);
+            n = 0;
+        }
+    }
+    fwrite(hex, 1, n, fp);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t val = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--) {
+        val = (val << 8) | p[i];
+    }
+
+    return val;
+}
+
+/**
+ * Write measurement record as json.
+ *
+ * The layout follows python json.dump(indent=2) so that the output can be
+ * diffed against SpdmMeasurement.py.
+ **/
+static bool meas_to_json(const uint8_t *rec, size_t len, int alg_id,
+                         FILE *fp)
+{
+    spdm_meas_block_t blk;
+    size_t offset = 0;
+    bool first = true;
+    int rc, alg;
+
+    fputs("{\n  \"evidences\": [", fp);
+
+    while ((rc = spdm_meas_next(rec, len, &offset, &blk)) > 0) {
+        fputs(first ? "\n" : ",\n", fp);
+        first = false;
+
+        fprintf(fp, "    {\n      \"evidence\": {\n        \"index\": %u,\n",
+                blk.index);
+        if (spdm_meas_is_digest(&blk)) {
+            alg = alg_id ? alg_id : spdm_meas_alg_id_by_size(blk.value_size);
+            fprintf(fp, "        \"digest\": [\n          %d,\n          \"",
+                    alg);
+            write_hex(fp, blk.value, blk.value_size);
+            fputs("\"\n        ]\n", fp);
+        } else if (spdm_meas_is_svn(&blk)) {
+            fprintf(fp, "        \"svn\": %llu\n",
+                    (unsigned long long)get_le64(blk.value));
+        } else {
+            /* Whole measurement after the DMTF header, as patch 0003. */
+            fputs("        \"raw\": \"", fp);
+            if (blk.size > SPDM_MEAS_DMTF_HDR_SIZE) {
+                write_hex(fp, blk.raw + SPDM_MEAS_BLOCK_HDR_SIZE +
+                          SPDM_MEAS_DMTF_HDR_SIZE,
+                          blk.size - SPDM_MEAS_DMTF_HDR_SIZE);
+            }
+            fputs("\"\n", fp);
+        }
+        fputs("      }\n    }", fp);
+    }
+
+    fputs(first ? "]\n}\n" : "\n  ]\n}\n", fp);
+
+    return rc == 0;
+}
+
+static void get_output_path(const meas_json_job_t *job, const char *input,
+                            char *path, size_t size)
+{
+    char name[PATH_MAX], *base, *dot;
+
+    snprintf(name, sizeof(name), "%s", input);
+    base = job->out_dir ? basename(name) : name;
+    dot = strrchr(base, '.');
+    if (dot && !strcmp(dot, ".bin")) {
+        *dot = '\0';
+    }
+
+    if (job->out_dir) {
+        snprintf(path, size, "%s/%s.json", job->out_dir, base);
+    } else {
+        snprintf(path, size, "%s.json", base);
+    }
+}
+
+static int compare_path(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Set the output file of every input. Workers run in parallel, so two
+ * inputs writing the same file, like <host>/device_measurement.bin with
+ * '-d', would overwrite each other: refuse them up front.
+ */
+static bool set_outputs(meas_json_job_t *job)
+{
+    char path[PATH_MAX], **sorted;
+    bool result = true;
+    int i;
+
+    job->outputs = calloc(job->count, sizeof(*job->outputs));
+    sorted = calloc(job->count, sizeof(*sorted));
+    if (!job->outputs || !sorted) {
+        fprintf(stderr, "out of memory\n");
+        free(sorted);
+        return false;
+    }
+
+    for (i = 0; i < job->count; i++) {
+        if (job->output) {
+            snprintf(path, sizeof(path), "%s", job->output);
+        } else {
+            get_output_path(job, job->inputs[i], path, sizeof(path));
+        }
+        job->outputs[i] = strdup(path);
+        if (!job->outputs[i]) {
+            fprintf(stderr, "out of memory\n");
+            free(sorted);
+            return false;
+        }
+        sorted[i] = job->outputs[i];
+    }
+
+    qsort(sorted, job->count, sizeof(*sorted), compare_path);
+    for (i = 1; i < job->count; i++) {
+        if (!strcmp(sorted[i - 1], sorted[i])) {
+            fprintf(stderr, "%s: output of several inputs%s\n", sorted[i],
+                    job->out_dir ? ", convert next to the inputs instead" :
+                    "");
+            result = false;
+        }
+    }
+
+    free(sorted);
+    return result;
+}
+
+static bool convert_file(const meas_json_job_t *job, const char *input,
+                         const char *output)
+{
+    uint8_t *rec = NULL;
+    struct stat st;
+    bool result;
+    FILE *fp;
+    int fd;
+
+    fd = open(input, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "%s: %m\n", input);
+        if (fd != -1) {
+            close(fd);
+        }
+        return false;
+    }
+
+    if (st.st_size) {
+        rec = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (rec == MAP_FAILED) {
+            fprintf(stderr, "%s: mmap - %m\n", input);
+            close(fd);
+            return false;
+        }
+        madvise(rec, st.st_size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    fp = strcmp(output, "-") ? fopen(output, "w") : stdout;
+    if (!fp) {
+        fprintf(stderr, "%s: %m\n", output);
+        result = false;
+        goto out;
+    }
+    if (fp != stdout) {
+        setvbuf(fp, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+    }
+
+    result = meas_to_json(rec, st.st_size, job->alg_id, fp);
+    if (!result) {
+        fprintf(stderr, "%s: malformed measurement record\n", input);
+    }
+
+    if (fp != stdout) {
+        if (fclose(fp)) {
+            fprintf(stderr, "%s: %m\n", output);
+            result = false;
+        }
+        if (!result) {
+            unlink(output);
+        }
+    }
+
+out:
+    if (rec) {
+        munmap(rec, st.st_size);
+    }
+    return result;
+}
+
+static void *convert_worker(void *arg)
+{
+    meas_json_job_t *job = arg;
+    int i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->count) {
+        if (!convert_file(job, job->inputs[i], job->outputs[i])) {
+            __atomic_fetch_add(&job->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [options] <device_measurement.bin>...\n"
+           "  -a <alg>   digest algorithm: sha256, sha384, sha512, sha3_256,\n"
+           "             sha3_384, sha3_512 (default: by digest size)\n"
+           "  -o <file>  output file for a single input, '-' for stdout\n"
+           "  -d <dir>   output directory (default: next to each input)\n"
+           "  -j <n>     number of worker threads (default: online CPUs)\n"
+           "Each <name>.bin is converted to <name>.json.\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[MAX_THREADS];
+    meas_json_job_t job = { 0 };
+    int opt, i, nthreads;
+
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt(argc, argv, "a:o:d:j:h")) != -1) {
+        switch (opt) {
+        case 'a':
+            job.alg_id = spdm_meas_alg_id(optarg);
+            if (!job.alg_id) {
+                fprintf(stderr, "Unknown algorithm %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            job.output = optarg;
+            break;
+        case 'd':
+            job.out_dir = optarg;
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    job.inputs = argv + optind;
+    job.count = argc - optind;
+    if (!job.count || (job.output && job.count != 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!set_outputs(&job)) {
+        return 1;
+    }
+
+    if (nthreads > job.count) {
+        nthreads = job.count;
+    }
+    if (nthreads > MAX_THREADS) {
+        nthreads = MAX_THREADS;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    for (i = 1; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, convert_worker, &job)) {
+            break;
+        }
+    }
+    convert_worker(&job);
+    while (--i > 0) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (job.failed) {
+        fprintf(stderr, "%d of %d files failed\n", job.failed, job.count);
+        return 1;
+    }
+
+    return 0;
+}
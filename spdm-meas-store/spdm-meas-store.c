@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Measurement history store tool.
+ *
+ * Keeps every collected device_measurement.bin and the digest of each
+ * device_cert_chain_N.bin in an append-only store, and answers history
+ * queries from the memory-mapped index without re-parsing any dump.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "spdm_hash.h"
+#include "spdm_meas.h"
+#include "spdm_store.h"
+
+#define DEFAULT_STORE_DIR "meas_store"
+
+static uint8_t *read_file(const char *path, size_t *len, uint64_t *mtime)
+{
+    struct stat st;
+    uint8_t *buf;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp || fstat(fileno(fp), &st) == -1) {
+        printf("%s: %m\n", path);
+        if (fp) {
+            fclose(fp);
+        }
+        return NULL;
+    }
+
+    buf = malloc(st.st_size ? st.st_size : 1);
+    if (buf && fread(buf, 1, st.st_size, fp) != (size_t)st.st_size) {
+        printf("%s: read error\n", path);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+
+    *len = st.st_size;
+    if (mtime) {
+        *mtime = st.st_mtime;
+    }
+    return buf;
+}
+
+static const char *format_time(uint64_t t, char *buf, size_t size)
+{
+    time_t tt = t;
+    struct tm tm;
+
+    gmtime_r(&tt, &tm);
+    strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    return buf;
+}
+
+/*
+ * add [-t time] [-s slot] <device_measurement.bin> [<device_cert_chain.bin>]
+ *
+ * The snapshot time defaults to the mtime of the measurement file so that
+ * old dumps can be imported in order.
+ */
+static int cmd_add(spdm_store_t *st, int argc, char *argv[])
+{
+    spdm_store_value_t values[257];
+    uint8_t *rec, *chain = NULL, digest[SPDM_HASH_SHA384_SIZE];
+    spdm_meas_block_t blk;
+    uint64_t time = 0;
+    size_t len, chain_len, offset = 0;
+    uint32_t count = 0;
+    int opt, rc = 1, slot = 0;
+
+    while ((opt = getopt(argc, argv, "t:s:")) != -1) {
+        switch (opt) {
+        case 't':
+            time = strtoull(optarg, NULL, 0);
+            break;
+        case 's':
+            slot = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("missing measurement file\n");
+        return 1;
+    }
+
+    rec = read_file(argv[optind], &len, time ? NULL : &time);
+    if (!rec) {
+        return 1;
+    }
+
+    while (count < 256 &&
+           spdm_meas_next(rec, len, &offset, &blk) > 0) {
+        values[count].kind = SPDM_STORE_MEAS;
+        values[count].index = blk.index;
+        values[count].data = blk.raw;
+        values[count].len = spdm_meas_block_size(&blk);
+        count++;
+    }
+    if (offset != len) {
+        printf("%s: malformed measurement record\n", argv[optind]);
+        goto out;
+    }
+
+    if (optind + 1 < argc) {
+        chain = read_file(argv[optind + 1], &chain_len, NULL);
+        if (!chain ||
+            spdm_hash(SPDM_HASH_SHA384_SIZE, chain, chain_len, digest)) {
+            goto out;
+        }
+        values[count].kind = SPDM_STORE_CERT;
+        values[count].index = slot;
+        values[count].data = digest;
+        values[count].len = sizeof(digest);
+        count++;
+    }
+
+    if (!count) {
+        printf("nothing to add\n");
+        goto out;
+    }
+
+    rc = spdm_store_append(st, time, values, count) ? 1 : 0;
+    if (!rc) {
+        printf("snapshot %u: %u values\n", st->snapshots - 1, count);
+    }
+
+out:
+    free(chain);
+    free(rec);
+    return rc;
+}
+
+static bool changes_wanted(const spdm_store_entry_t *e, int index)
+{
+    return index < 0 || (e->kind == SPDM_STORE_MEAS && e->index == index);
+}
+
+/*
+ * changes [-i index]: list every value added, changed or removed, oldest
+ * first.
+ */
+static int cmd_changes(spdm_store_t *st, int argc, char *argv[])
+{
+    const spdm_store_entry_t *e;
+    int opt, index = -1;
+    uint32_t n, start, end;
+    char buf[32];
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+        case 'i':
+            index = atoi(optarg);
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    for (start = 0; start < st->count; start = end) {
+        e = spdm_store_entry(st, start);
+        end = start + 1;
+        while (end < st->count &&
+               spdm_store_entry(st, end)->snapshot == e->snapshot) {
+            end++;
+        }
+        format_time(e->time, buf, sizeof(buf));
+
+        /* Look values up in the snapshot before, which ends at start - 1. */
+        for (n = start; n < end; n++) {
+            e = spdm_store_entry(st, n);
+            if (e->changed != n || !changes_wanted(e, index)) {
+                continue;
+            }
+            printf("%s snapshot %u: %s %u %s\n", buf, e->snapshot,
+                   e->kind == SPDM_STORE_MEAS ? "index" : "cert slot",
+                   e->index,
+                   start && spdm_store_find_in(st, start - 1, e->kind,
+                                               e->index) ?
+                   "changed" : "added");
+        }
+
+        if (!start) {
+            continue;
+        }
+        for (n = spdm_store_snapshot_start(st, start - 1); n < start; n++) {
+            e = spdm_store_entry(st, n);
+            if (!changes_wanted(e, index) ||
+                spdm_store_find_in(st, end - 1, e->kind, e->index)) {
+                continue;
+            }
+            printf("%s snapshot %u: %s %u removed\n", buf,
+                   spdm_store_entry(st, start)->snapshot,
+                   e->kind == SPDM_STORE_MEAS ? "index" : "cert slot",
+                   e->index);
+        }
+    }
+
+    return 0;
+}
+
+/* last-change <index>: when the current value of an index appeared. */
+static int cmd_last_change(spdm_store_t *st, int argc, char *argv[])
+{
+    const spdm_store_entry_t *e;
+    char buf[32];
+
+    if (optind >= argc) {
+        printf("missing index\n");
+        return 1;
+    }
+
+    e = spdm_store_find(st, SPDM_STORE_MEAS, atoi(argv[optind]), UINT64_MAX);
+    if (!e) {
+        printf("index %s not in the latest snapshot\n", argv[optind]);
+        return 1;
+    }
+
+    e = spdm_store_entry(st, e->changed);
+    printf("%s snapshot %u\n", format_time(e->time, buf, sizeof(buf)),
+           e->snapshot);
+
+    return 0;
+}
+
+/* get [-t time] <output.bin>: measurement record as of a time. */
+static int cmd_get(spdm_store_t *st, int argc, char *argv[])
+{
+    const spdm_store_entry_t *e;
+    uint64_t time = UINT64_MAX;
+    const uint8_t *data;
+    uint32_t n, last;
+    int opt, rc = 0;
+    FILE *fp;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+        switch (opt) {
+        case 't':
+            time = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        printf("missing output file\n");
+        return 1;
+    }
+
+    last = spdm_store_snapshot_end(st, time);
+    if (!last) {
+        printf("no snapshot at that time\n");
+        return 1;
+    }
+    last--;
+
+    fp = strcmp(argv[optind], "-") ? fopen(argv[optind], "wb") : stdout;
+    if (!fp) {
+        printf("%s: %m\n", argv[optind]);
+        return 1;
+    }
+    for (n = spdm_store_snapshot_start(st, last); n <= last; n++) {
+        e = spdm_store_entry(st, n);
+        if (e->kind != SPDM_STORE_MEAS) {
+            continue;
+        }
+        data = spdm_store_data(st, e);
+        if (!data) {
+            printf("entry %u: data out of the store, corrupt\n", n);
+            rc = 1;
+        } else if (fwrite(data, 1, e->len, fp) != e->len) {
+            rc = 1;
+        }
+    }
+    if (fp != stdout && fclose(fp)) {
+        rc = 1;
+    }
+
+    return rc;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [-d <store>] <command> [args]\n"
+           "  add [-t time] [-s slot] <measurement.bin> [<cert_chain.bin>]\n"
+           "                       append a snapshot (time: file mtime)\n"
+           "  changes [-i index]   list values added, changed or removed\n"
+           "  last-change <index>  when the current value of index appeared\n"
+           "  get [-t time] <out>  measurement record as of time\n"
+           "Times are seconds since the epoch. Default store: %s\n",
+           prog, DEFAULT_STORE_DIR);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = DEFAULT_STORE_DIR, *cmd;
+    spdm_store_t st;
+    int opt, rc;
+
+    while ((opt = getopt(argc, argv, "+d:h")) != -1) {
+        switch (opt) {
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cmd = argv[optind];
+    argc -= optind;
+    argv += optind;
+    optind = 1;
+
+    if (spdm_store_open(&st, dir, !strcmp(cmd, "add"))) {
+        return 1;
+    }
+
+    if (!strcmp(cmd, "add")) {
+        rc = cmd_add(&st, argc, argv);
+    } else if (!strcmp(cmd, "changes")) {
+        rc = cmd_changes(&st, argc, argv);
+    } else if (!strcmp(cmd, "last-change")) {
+        rc = cmd_last_change(&st, argc, argv);
+    } else if (!strcmp(cmd, "get")) {
+        rc = cmd_get(&st, argc, argv);
+    } else {
+        usage(argv[0]);
+        rc = 1;
+    }
+
+    spdm_store_close(&st);
+    return rc;
+}
@@ -0,0 +1,416 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Incremental SPDM measurement collection.
+ *
+ * Instead of fetching all measurements with raw bit streams on every run,
+ * ask the device for a signed summary first: all measurement blocks in
+ * digest form. Only indices whose digest differs from the last verified
+ * summary are fetched in full, and only those are reported. The chain must
+ * lead to a trusted root, and every block saved must be covered by the
+ * signed summary.
+ *
+ * State kept in the output directory:
+ *   device_measurement.bin           full record, as spdm_requester_emu
+ *   device_measurement_summary.bin   digest form record of the last run
+ *   device_measurement_delta.bin     blocks changed in the last run
+ *   device_measurement_sig.bin       signed summary exchange, for offline
+ *                                    verification with spdm-batch-verify
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "psc_mailbox.h"
+#include "spdm_meas.h"
+#include "spdm_req.h"
+#include "spdm_verify.h"
+
+#define MEAS_FILE       "device_measurement.bin"
+#define SUMMARY_FILE    "device_measurement_summary.bin"
+#define DELTA_FILE      "device_measurement_delta.bin"
+#define SIG_FILE        "device_measurement_sig.bin"
+
+#define MAX_RECORD_SIZE (256 * SPDM_REQ_MAX_MSG_SIZE)
+#define MAX_EVIDENCE_SIZE \
+    (SPDM_EVIDENCE_HDR_SIZE + SPDM_REQ_MAX_TRANSCRIPT_SIZE + 512)
+
+/* Measurement record being assembled. */
+typedef struct meas_buf {
+    uint8_t *data;
+    size_t len;
+} meas_buf_t;
+
+static spdm_req_t m_req;
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    uint8_t *buf;
+    long size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = malloc(size ? size : 1);
+    if (buf && fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+
+    *len = size;
+    return buf;
+}
+
+/* Replace the file atomically so that readers never see a partial record. */
+static bool write_file(const char *dir, const char *name, const uint8_t *buf,
+                       size_t len)
+{
+    char path[PATH_MAX], tmp[PATH_MAX + 4];
+    bool result;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    fp = fopen(tmp, "wb");
+    if (!fp) {
+        printf("%s: %m\n", tmp);
+        return false;
+    }
+    result = fwrite(buf, 1, len, fp) == len;
+    result = !fclose(fp) && result;
+    if (!result || rename(tmp, path)) {
+        printf("%s: %m\n", path);
+        unlink(tmp);
+        return false;
+    }
+
+    printf("write file - %s\n", path);
+    return true;
+}
+
+static bool append_block(meas_buf_t *buf, const spdm_meas_block_t *blk)
+{
+    size_t size = spdm_meas_block_size(blk);
+
+    if (buf->len + size > MAX_RECORD_SIZE) {
+        printf("measurement record too large\n");
+        return false;
+    }
+    memcpy(buf->data + buf->len, blk->raw, size);
+    buf->len += size;
+
+    return true;
+}
+
+static bool same_block(const spdm_meas_block_t *a, const spdm_meas_block_t *b)
+{
+    return a->raw && b->raw && a->size == b->size &&
+           !memcmp(a->raw, b->raw, spdm_meas_block_size(a));
+}
+
+/*
+ * Get measurements and verify the signature if one was requested. The
+ * signed exchange is saved in evidence if not NULL.
+ */
+static bool get_measurements(spdm_pubkey_t *key, uint8_t attr, uint8_t op,
+                             uint8_t slot, meas_buf_t *out,
+                             meas_buf_t *evidence)
+{
+    spdm_meas_rsp_t rsp;
+    spdm_evidence_t ev;
+
+    if (spdm_req_get_measurements(&m_req, attr, op, slot, &rsp)) {
+        return false;
+    }
+
+    if ((attr & SPDM_MEAS_ATTR_SIGNATURE) &&
+        !spdm_verify_meas_signature(key, m_req.version, m_req.base_hash_algo,
+                                    m_req.base_asym_algo, rsp.transcript,
+                                    rsp.transcript_len, rsp.signature,
+                                    rsp.signature_len)) {
+        printf("verify_measurement_signature - FAIL\n");
+        return false;
+    }
+
+    if ((attr & SPDM_MEAS_ATTR_SIGNATURE) && evidence) {
+        ev.version = m_req.version;
+        ev.slot = slot;
+        ev.meas_hash_algo = m_req.meas_hash_algo;
+        ev.base_hash_algo = m_req.base_hash_algo;
+        ev.base_asym_algo = m_req.base_asym_algo;
+        ev.transcript = rsp.transcript;
+        ev.transcript_len = rsp.transcript_len;
+        ev.record = rsp.transcript + rsp.record_offset;
+        ev.record_len = rsp.record_len;
+        ev.signature = rsp.signature;
+        ev.signature_len = rsp.signature_len;
+        evidence->len = spdm_evidence_encode(&ev, evidence->data,
+                                             MAX_EVIDENCE_SIZE);
+        if (!evidence->len) {
+            printf("evidence too large\n");
+            return false;
+        }
+    }
+
+    if (out->len + rsp.record_len > MAX_RECORD_SIZE) {
+        printf("measurement record too large\n");
+        return false;
+    }
+    memcpy(out->data + out->len, rsp.record, rsp.record_len);
+    out->len += rsp.record_len;
+
+    return true;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s -r <root.der> [-r ...] [options]\n"
+           "  -r <file>  trusted root certificate, DER\n"
+           "  -d <dir>   state directory (default: .)\n"
+           "  -c <file>  device certificate chain\n"
+           "             (default: <dir>/device_cert_chain_<slot>.bin)\n"
+           "  -s <slot>  certificate slot (default: 0)\n"
+           "  -F         full collection, ignore the previous state\n",
+           prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static spdm_meas_block_t old_sum[256], old_full[256], sum[256], got[256];
+    meas_buf_t summary = { 0 }, fetched = { 0 }, full = { 0 }, delta = { 0 };
+    meas_buf_t evidence = { 0 };
+    uint8_t *old_sum_rec = NULL, *old_full_rec = NULL, *chain = NULL;
+    bool need_full[256] = { false }, force = false, flow = false;
+    size_t old_sum_len = 0, old_full_len = 0, chain_len;
+    const char *dir = ".", *cert = NULL;
+    char path[PATH_MAX], chain_path[PATH_MAX];
+    int opt, i, nblocks, nfetch = 0, nchanged = 0, rc = 1;
+    spdm_cert_cache_t *cache = NULL;
+    spdm_pubkey_t *key = NULL;
+    uint8_t slot = 0, attr, *der;
+    size_t der_len;
+    int status;
+    size_t offset;
+    spdm_meas_block_t blk;
+
+    while ((opt = getopt(argc, argv, "r:d:c:s:Fh")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (!cache && !(cache = spdm_cert_cache_new())) {
+                printf("out of memory\n");
+                goto out;
+            }
+            der = read_file(optarg, &der_len);
+            if (!der) {
+                printf("%s: %m\n", optarg);
+                goto out;
+            }
+            if (!spdm_cert_cache_add_root(cache, der, der_len)) {
+                free(der);
+                goto out;
+            }
+            free(der);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 'c':
+            cert = optarg;
+            break;
+        case 's':
+            slot = atoi(optarg) & 0xF;
+            break;
+        case 'F':
+            force = true;
+            break;
+        default:
+            usage(argv[0]);
+            rc = opt == 'h' ? 0 : 1;
+            goto out;
+        }
+    }
+
+    if (!cache) {
+        printf("a trusted root is required (-r)\n");
+        goto out;
+    }
+
+    if (!cert) {
+        snprintf(chain_path, sizeof(chain_path), "%s/device_cert_chain_%u.bin",
+                 dir, slot);
+        cert = chain_path;
+    }
+    chain = read_file(cert, &chain_len);
+    if (!chain) {
+        printf("%s: %m\n", cert);
+        goto out;
+    }
+
+    /* The previous state is only usable if both records are present. */
+    if (!force) {
+        snprintf(path, sizeof(path), "%s/%s", dir, SUMMARY_FILE);
+        old_sum_rec = read_file(path, &old_sum_len);
+        snprintf(path, sizeof(path), "%s/%s", dir, MEAS_FILE);
+        old_full_rec = read_file(path, &old_full_len);
+    }
+    if (!old_sum_rec || !old_full_rec ||
+        spdm_meas_index(old_sum_rec, old_sum_len, old_sum) < 0 ||
+        spdm_meas_index(old_full_rec, old_full_len, old_full) < 0) {
+        memset(old_sum, 0, sizeof(old_sum));
+        memset(old_full, 0, sizeof(old_full));
+    }
+
+    summary.data = malloc(MAX_RECORD_SIZE);
+    fetched.data = malloc(MAX_RECORD_SIZE);
+    full.data = malloc(MAX_RECORD_SIZE);
+    delta.data = malloc(MAX_RECORD_SIZE);
+    evidence.data = malloc(MAX_EVIDENCE_SIZE);
+    if (!summary.data || !fetched.data || !full.data || !delta.data ||
+        !evidence.data) {
+        printf("out of memory\n");
+        goto out;
+    }
+
+    if (psc_mailbox_init() ||
+        psc_mailbox_flow_lock(PSC_MAILBOX_FLOW_TIMEOUT_MSEC)) {
+        printf("Fail to connect to PSC\n");
+        goto out;
+    }
+    flow = true;
+    if (spdm_req_connect(&m_req)) {
+        printf("Fail to connect to PSC\n");
+        goto out;
+    }
+
+    status = spdm_chain_verify(cache, chain, chain_len,
+                               spdm_hash_size(m_req.base_hash_algo), &key);
+    if (status != SPDM_CHAIN_OK) {
+        printf("%s: %s\n", cert, spdm_chain_strerror(status));
+        goto out;
+    }
+
+    /* Signed summary: every block in digest form. */
+    if (!get_measurements(key, SPDM_MEAS_ATTR_SIGNATURE, SPDM_MEAS_OP_ALL,
+                          slot, &summary, &evidence)) {
+        goto out;
+    }
+    nblocks = spdm_meas_index(summary.data, summary.len, sum);
+    if (nblocks < 0) {
+        printf("malformed measurement record\n");
+        goto out;
+    }
+
+    /*
+     * Fetch changed indices in full if they may have a raw form: new ones,
+     * and those the previous full record didn't hold in digest form. Raw
+     * bit streams can only be requested from SPDM 1.2 on.
+     */
+    for (i = 0; i < 256; i++) {
+        if (!sum[i].raw) {
+            if (old_sum[i].raw) {
+                printf("index %d: removed\n", i);
+                nchanged++;
+            }
+            continue;
+        }
+        if (same_block(&sum[i], &old_sum[i])) {
+            continue;
+        }
+
+        printf("index %d: %s\n", i, old_sum[i].raw ? "changed" : "added");
+        nchanged++;
+        if (m_req.version >= SPDM_VERSION_12 &&
+            (!old_full[i].raw || !same_block(&old_full[i], &old_sum[i]))) {
+            need_full[i] = true;
+            nfetch++;
+        }
+    }
+
+    if (nfetch && nfetch == nblocks) {
+        if (!get_measurements(key, SPDM_MEAS_ATTR_SIGNATURE |
+                              SPDM_MEAS_ATTR_RAW_BIT_STREAM,
+                              SPDM_MEAS_OP_ALL, slot, &fetched, NULL)) {
+            goto out;
+        }
+    } else {
+        /* Sign the last request, which covers all of them in L1. */
+        for (i = 0; i < 256 && nfetch; i++) {
+            if (!need_full[i]) {
+                continue;
+            }
+            attr = SPDM_MEAS_ATTR_RAW_BIT_STREAM;
+            if (!--nfetch) {
+                attr |= SPDM_MEAS_ATTR_SIGNATURE;
+            }
+            if (!get_measurements(key, attr, i, slot, &fetched, NULL)) {
+                goto out;
+            }
+        }
+    }
+    if (spdm_meas_index(fetched.data, fetched.len, got) < 0) {
+        printf("malformed measurement record\n");
+        goto out;
+    }
+
+    /* Assemble the new full record in summary order. */
+    offset = 0;
+    while (spdm_meas_next(summary.data, summary.len, &offset, &blk) > 0) {
+        i = blk.index;
+        if (need_full[i] && got[i].raw) {
+            blk = got[i];
+        } else if (same_block(&sum[i], &old_sum[i]) && old_full[i].raw) {
+            blk = old_full[i];
+        }
+        if (!spdm_meas_block_signed(&blk, &sum[i], m_req.meas_hash_algo)) {
+            printf("index %d: not covered by the signed summary%s\n", i,
+                   blk.raw == got[i].raw ? "" : ", retry with -F");
+            goto out;
+        }
+
+        if (!append_block(&full, &blk) ||
+            (!same_block(&sum[i], &old_sum[i]) &&
+             !append_block(&delta, &blk))) {
+            goto out;
+        }
+    }
+
+    if (!write_file(dir, MEAS_FILE, full.data, full.len) ||
+        !write_file(dir, SUMMARY_FILE, summary.data, summary.len) ||
+        !write_file(dir, DELTA_FILE, delta.data, delta.len) ||
+        !write_file(dir, SIG_FILE, evidence.data, evidence.len)) {
+        goto out;
+    }
+
+    printf("%d of %d indices changed\n", nchanged, nblocks);
+    rc = 0;
+
+out:
+    if (flow) {
+        psc_mailbox_flow_unlock();
+    }
+    spdm_pubkey_free(key);
+    free(summary.data);
+    free(fetched.data);
+    free(full.data);
+    free(delta.data);
+    free(evidence.data);
+    free(old_sum_rec);
+    free(old_full_rec);
+    free(chain);
+    spdm_cert_cache_free(cache);
+    return rc;
+}
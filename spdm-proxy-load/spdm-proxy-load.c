@@ -0,0 +1,776 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Load generator and tail latency harness for spdm-proxy.
+ *
+ * "run" drives spdm-proxy over the platform protocol from many connections
+ * at once, each one a native requester (lib/spdm_req) doing a weighted mix
+ * of operations, and reports throughput and latency percentiles per SPDM
+ * request and per operation. "sim" serves a simulated PSC register window
+ * that spdm-proxy can use with '-w', to capacity-test the proxy on any host.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "psc_sim.h"
+#include "spdm_platform.h"
+#include "spdm_proto.h"
+#include "spdm_req.h"
+
+#define DEFAULT_ADDRESS         "127.0.0.1"
+#define DEFAULT_DURATION_SEC    10U
+#define DEFAULT_MIX             "vca:1,cert:1,meas:4"
+#define MAX_CONNECTIONS         1024U
+
+/* Wait before reconnecting after a failed connect. */
+#define RECONNECT_WAIT_USEC     10000U
+
+/* Check for the end of the run this often. */
+#define WAIT_POLL_USEC          10000U
+
+/*
+ * Latency histogram, in ns. Values below 2^HIST_SUB_BITS are exact, above
+ * that each power of two is split in 2^(HIST_SUB_BITS - 1) buckets, which
+ * keeps every bucket within 3% of its value. Max about 68 s.
+ */
+#define HIST_SUB_BITS           6U
+#define HIST_SUB_HALF           (1U << (HIST_SUB_BITS - 1U))
+#define HIST_MAX_BITS           36U
+#define HIST_BUCKETS            ((HIST_MAX_BITS - HIST_SUB_BITS + 2U) * \
+                                 HIST_SUB_HALF)
+
+typedef struct hist {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t max;
+    uint32_t buckets[HIST_BUCKETS];
+} hist_t;
+
+/* Operations of the request mix. */
+enum {
+    OP_VCA,         /* GET_VERSION, GET_CAPABILITIES, NEGOTIATE_ALGORITHMS */
+    OP_CERT,        /* certificate chain of slot 0, in 1K portions */
+    OP_MEAS,        /* signed GET_MEASUREMENTS for all indices */
+    OP_MEAS_IDX,    /* count, then every index, the last one signed */
+    NUM_OPS
+};
+
+static const char *const op_names[NUM_OPS] = {
+    "vca", "cert", "meas", "meas-idx"
+};
+
+/* Latency statistics: connect, SPDM requests, operations. */
+enum {
+    STAT_CONNECT,
+    STAT_GET_VERSION,
+    STAT_GET_CAPABILITIES,
+    STAT_NEGOTIATE_ALGORITHMS,
+    STAT_GET_CERTIFICATE,
+    STAT_GET_MEASUREMENTS,
+    STAT_OTHER,
+    STAT_BATCH,     /* SOCKET_SPDM_COMMAND_BATCH frames */
+    STAT_OP,
+    NUM_STATS = STAT_OP + NUM_OPS
+};
+
+static const char *const stat_names[STAT_OP] = {
+    "connect", "GET_VERSION", "GET_CAPABILITIES", "NEGOTIATE_ALGORITHMS",
+    "GET_CERTIFICATE", "GET_MEASUREMENTS", "other", "batch"
+};
+
+typedef struct worker {
+    pthread_t thread;
+    uint32_t id;
+    unsigned int seed;
+    int sock;
+    spdm_req_t req;
+    uint8_t chain[SPDM_REQ_MAX_CERT_CHAIN_SIZE];
+
+    uint64_t ops;
+    uint64_t messages;
+    uint64_t bytes;
+    hist_t stats[NUM_STATS];
+} worker_t;
+
+/* Run options. */
+static const char *m_address = DEFAULT_ADDRESS;
+static uint16_t m_port = DEFAULT_SPDM_PLATFORM_PORT;
+static uint32_t m_connections = 1;
+static uint32_t m_duration = DEFAULT_DURATION_SEC;
+static uint64_t m_max_ops;
+static double m_rate;
+static uint32_t m_reconnect;
+static bool m_nodelay;
+static bool m_batch;
+static uint32_t m_weights[NUM_OPS];
+static uint32_t m_total_weight;
+
+static volatile sig_atomic_t m_stop;
+static uint64_t m_start;
+static uint32_t m_done;
+
+static uint64_t get_nsec(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void handle_stop(int sig)
+{
+    m_stop = 1;
+}
+
+static uint32_t hist_index(uint64_t val)
+{
+    uint32_t msb, shift;
+
+    if (val < (1U << HIST_SUB_BITS)) {
+        return val;
+    }
+
+    msb = 63 - __builtin_clzll(val);
+    if (msb >= HIST_MAX_BITS) {
+        return HIST_BUCKETS - 1U;
+    }
+    shift = msb - (HIST_SUB_BITS - 1U);
+
+    return (shift + 1U) * HIST_SUB_HALF + (val >> shift) - HIST_SUB_HALF;
+}
+
+/* Upper bound of a bucket. */
+static uint64_t hist_value(uint32_t index)
+{
+    uint32_t shift;
+
+    if (index < (1U << HIST_SUB_BITS)) {
+        return index;
+    }
+
+    shift = index / HIST_SUB_HALF - 1U;
+
+    return ((uint64_t)(index % HIST_SUB_HALF + HIST_SUB_HALF + 1U) << shift) -
+        1U;
+}
+
+static void hist_add(hist_t *h, uint64_t val)
+{
+    h->buckets[hist_index(val)]++;
+    h->count++;
+    if (val > h->max) {
+        h->max = val;
+    }
+}
+
+static void hist_merge(hist_t *dst, const hist_t *src)
+{
+    uint32_t i;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->errors += src->errors;
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+static uint64_t hist_percentile(const hist_t *h, double p)
+{
+    uint64_t rank, sum = 0;
+    uint32_t i;
+
+    rank = h->count * p;
+    if (rank >= h->count) {
+        rank = h->count - 1;
+    }
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        sum += h->buckets[i];
+        if (sum > rank) {
+            break;
+        }
+    }
+
+    return hist_value(i) < h->max ? hist_value(i) : h->max;
+}
+
+static uint32_t msg_stat(uint8_t code)
+{
+    switch (code) {
+    case SPDM_GET_VERSION:
+        return STAT_GET_VERSION;
+    case SPDM_GET_CAPABILITIES:
+        return STAT_GET_CAPABILITIES;
+    case SPDM_NEGOTIATE_ALGORITHMS:
+        return STAT_NEGOTIATE_ALGORITHMS;
+    case SPDM_GET_CERTIFICATE:
+        return STAT_GET_CERTIFICATE;
+    case SPDM_GET_MEASUREMENTS:
+        return STAT_GET_MEASUREMENTS;
+    default:
+        return STAT_OTHER;
+    }
+}
+
+/* spdm_req transport: one frame through spdm-proxy, timed. */
+static bool worker_xfer(void *ctx, const uint8_t *req, uint32_t req_len,
+                        uint8_t *rsp, uint32_t *rsp_len)
+{
+    worker_t *w = ctx;
+    hist_t *h = &w->stats[msg_stat(req_len > 2 ? req[2] : 0)];
+    uint64_t t0 = get_nsec();
+
+    if (!spdm_platform_xfer(w->sock, req, req_len, rsp, rsp_len)) {
+        if (!m_stop) {
+            h->errors++;
+        }
+        return false;
+    }
+
+    hist_add(h, get_nsec() - t0);
+    w->messages++;
+    w->bytes += req_len + *rsp_len;
+
+    return true;
+}
+
+/* spdm_req batch transport: one SOCKET_SPDM_COMMAND_BATCH frame, timed. */
+static int worker_xfer_batch(void *ctx, uint32_t n, const uint8_t *const req[],
+                             const uint32_t req_len[], uint8_t *const rsp[],
+                             uint32_t rsp_len[])
+{
+    worker_t *w = ctx;
+    hist_t *h = &w->stats[STAT_BATCH];
+    uint64_t t0 = get_nsec();
+    int count, i;
+
+    count = spdm_platform_xfer_batch(w->sock, n, req, req_len, rsp, rsp_len);
+    if (count < 0) {
+        if (!m_stop) {
+            h->errors++;
+        }
+        return -1;
+    }
+
+    hist_add(h, get_nsec() - t0);
+    w->messages += count;
+    for (i = 0; i < count; i++) {
+        w->bytes += req_len[i] + rsp_len[i];
+    }
+
+    return count;
+}
+
+static bool worker_connect(worker_t *w)
+{
+    uint64_t t0 = get_nsec();
+    int sock;
+
+    sock = spdm_platform_connect(m_address, m_port, m_nodelay);
+    if (sock == -1) {
+        w->stats[STAT_CONNECT].errors++;
+        return false;
+    }
+
+    hist_add(&w->stats[STAT_CONNECT], get_nsec() - t0);
+    __atomic_store_n(&w->sock, sock, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+static void worker_disconnect(worker_t *w)
+{
+    int sock = __atomic_exchange_n(&w->sock, -1, __ATOMIC_ACQ_REL);
+
+    if (sock != -1) {
+        close(sock);
+    }
+}
+
+static uint32_t worker_pick_op(worker_t *w)
+{
+    uint32_t r = rand_r(&w->seed) % m_total_weight, op;
+
+    for (op = 0; op < NUM_OPS - 1; op++) {
+        if (r < m_weights[op]) {
+            break;
+        }
+        r -= m_weights[op];
+    }
+
+    return op;
+}
+
+static bool worker_run_op(worker_t *w, uint32_t op)
+{
+    spdm_meas_rsp_t rsp, batch[SPDM_REQ_MAX_BATCH];
+    uint8_t attr, ops[SPDM_REQ_MAX_BATCH];
+    uint32_t len, i, n, total;
+
+    switch (op) {
+    case OP_VCA:
+        return !spdm_req_connect(&w->req);
+
+    case OP_CERT:
+        return !spdm_req_get_certificate(&w->req, 0, w->chain, &len);
+
+    case OP_MEAS:
+        return !spdm_req_get_measurements(&w->req, SPDM_MEAS_ATTR_SIGNATURE,
+                                          SPDM_MEAS_OP_ALL, 0, &rsp);
+
+    case OP_MEAS_IDX:
+        if (spdm_req_get_measurements(&w->req, 0, SPDM_MEAS_OP_COUNT, 0,
+                                      &rsp)) {
+            return false;
+        }
+        total = rsp.total;
+        if (m_batch) {
+            /* The last request of the last batch is the signed one. */
+            for (i = 1; i <= total; i += n) {
+                for (n = 0; n < SPDM_REQ_MAX_BATCH && i + n <= total; n++) {
+                    ops[n] = i + n;
+                }
+                attr = i + n > total ? SPDM_MEAS_ATTR_SIGNATURE : 0;
+                if (spdm_req_get_measurements_batch(&w->req, attr, ops, n, 0,
+                                                    batch)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        for (i = 1; i <= total; i++) {
+            attr = i == total ? SPDM_MEAS_ATTR_SIGNATURE : 0;
+            if (spdm_req_get_measurements(&w->req, attr, i, 0, &rsp)) {
+                return false;
+            }
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+/* Connect and run VCA, which is timed as an operation of its own. */
+static bool worker_setup(worker_t *w)
+{
+    uint64_t t0;
+
+    if (!worker_connect(w)) {
+        return false;
+    }
+
+    t0 = get_nsec();
+    if (!worker_run_op(w, OP_VCA)) {
+        if (!m_stop) {
+            w->stats[STAT_OP + OP_VCA].errors++;
+        }
+        worker_disconnect(w);
+        return false;
+    }
+    hist_add(&w->stats[STAT_OP + OP_VCA], get_nsec() - t0);
+
+    return true;
+}
+
+/*
+ * Connection loop
+ *
+ * Every connection starts with VCA, then runs random operations from the
+ * mix; '-n' and '-k' only count the latter. With a rate, operations are
+ * scheduled at fixed intervals and their latency counts from the scheduled
+ * time, so a stalled proxy shows up in the tail instead of just slowing
+ * the load down.
+ */
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    uint64_t interval = 0, next = m_start, t0, t1;
+    uint32_t op, conn_ops = 0;
+    struct timespec ts;
+    bool result;
+
+    w->req.xfer = worker_xfer;
+    w->req.xfer_ctx = w;
+    if (m_batch) {
+        w->req.xfer_batch = worker_xfer_batch;
+    }
+
+    if (m_rate > 0) {
+        interval = 1e9 * m_connections / m_rate;
+        next += interval * w->id / m_connections;
+    }
+
+    while (!m_stop && (!m_max_ops || w->ops < m_max_ops)) {
+        if (w->sock == -1) {
+            if (!worker_setup(w)) {
+                usleep(RECONNECT_WAIT_USEC);
+                continue;
+            }
+            conn_ops = 0;
+        }
+
+        op = worker_pick_op(w);
+
+        if (interval) {
+            t0 = get_nsec();
+            if (next > t0) {
+                ts.tv_sec = next / 1000000000ULL;
+                ts.tv_nsec = next % 1000000000ULL;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+            t0 = next;
+            next += interval;
+        } else {
+            t0 = get_nsec();
+        }
+
+        result = worker_run_op(w, op);
+        t1 = get_nsec();
+        if (m_stop) {
+            break;
+        }
+
+        w->ops++;
+        conn_ops++;
+        if (result) {
+            hist_add(&w->stats[STAT_OP + op], t1 - t0);
+        } else {
+            w->stats[STAT_OP + op].errors++;
+            worker_disconnect(w);
+        }
+
+        if (m_reconnect && conn_ops >= m_reconnect) {
+            worker_disconnect(w);
+        }
+    }
+
+    worker_disconnect(w);
+    __atomic_fetch_add(&m_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool parse_mix(const char *mix)
+{
+    char buf[256], *tok, *save, *colon;
+    uint32_t op;
+
+    snprintf(buf, sizeof(buf), "%s", mix);
+    memset(m_weights, 0, sizeof(m_weights));
+    m_total_weight = 0;
+
+    for (tok = strtok_r(buf, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        colon = strchr(tok, ':');
+        if (colon) {
+            *colon++ = '\0';
+        }
+        for (op = 0; op < NUM_OPS; op++) {
+            if (!strcmp(tok, op_names[op])) {
+                break;
+            }
+        }
+        if (op == NUM_OPS) {
+            printf("unknown operation '%s'\n", tok);
+            return false;
+        }
+        m_weights[op] = colon ? strtoul(colon, NULL, 0) : 1;
+        m_total_weight += m_weights[op];
+    }
+
+    if (!m_total_weight) {
+        printf("empty request mix\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void print_stat(const char *name, const hist_t *h)
+{
+    if (!h->count && !h->errors) {
+        return;
+    }
+
+    if (!h->count) {
+        printf("%-22s %9lu %7lu\n", name, h->errors, h->errors);
+        return;
+    }
+
+    printf("%-22s %9lu %7lu %9.1f %9.1f %9.1f %9.1f\n", name,
+           h->count + h->errors, h->errors,
+           hist_percentile(h, 0.5) / 1000.0,
+           hist_percentile(h, 0.99) / 1000.0,
+           hist_percentile(h, 0.999) / 1000.0, h->max / 1000.0);
+}
+
+/*
+ * Print the run summary. Returns true if some operation succeeded and
+ * nothing failed, connections and messages included.
+ */
+static bool report(worker_t *workers, double elapsed)
+{
+    static hist_t total[NUM_STATS];
+    uint64_t ops = 0, messages = 0, bytes = 0, errors = 0, all_errors = 0;
+    uint64_t succeeded = 0;
+    char name[32];
+    uint32_t i, s;
+
+    for (i = 0; i < m_connections; i++) {
+        messages += workers[i].messages;
+        bytes += workers[i].bytes;
+        for (s = 0; s < NUM_STATS; s++) {
+            hist_merge(&total[s], &workers[i].stats[s]);
+        }
+    }
+    for (s = 0; s < NUM_STATS; s++) {
+        all_errors += total[s].errors;
+    }
+    for (s = STAT_OP; s < NUM_STATS; s++) {
+        ops += total[s].count + total[s].errors;
+        errors += total[s].errors;
+        succeeded += total[s].count;
+    }
+
+    printf("%u connections, %.1f s: %lu ops (%.1f/s), %lu messages (%.1f/s), "
+           "%.2f MB/s, %lu failed ops\n", m_connections, elapsed, ops,
+           ops / elapsed, messages, messages / elapsed,
+           bytes / elapsed / 1e6, errors);
+    printf("%-22s %9s %7s %9s %9s %9s %9s\n", "latency (us)", "count",
+           "errors", "p50", "p99", "p999", "max");
+    for (s = 0; s < STAT_OP; s++) {
+        print_stat(stat_names[s], &total[s]);
+    }
+    for (s = STAT_OP; s < NUM_STATS; s++) {
+        snprintf(name, sizeof(name), "op %s", op_names[s - STAT_OP]);
+        print_stat(name, &total[s]);
+    }
+
+    if (!succeeded) {
+        printf("no operation succeeded\n");
+    } else if (all_errors) {
+        printf("%lu errors\n", all_errors);
+    }
+
+    return succeeded && !all_errors;
+}
+
+/*
+ * run [-a addr] [-p port] [-c conns] [-t sec] [-n ops] [-r rate] [-m mix]
+ *     [-k ops] [-N] [-B]
+ */
+static int cmd_run(int argc, char *argv[])
+{
+    const char *mix = DEFAULT_MIX;
+    struct sigaction sa;
+    worker_t *workers;
+    uint64_t deadline;
+    uint32_t i, started;
+    int opt, sock, rc = 0;
+
+    while ((opt = getopt(argc, argv, "a:p:c:t:n:r:m:k:NB")) != -1) {
+        switch (opt) {
+        case 'a':
+            m_address = optarg;
+            break;
+        case 'p':
+            m_port = atoi(optarg);
+            break;
+        case 'c':
+            m_connections = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            m_duration = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            m_max_ops = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            m_rate = atof(optarg);
+            break;
+        case 'm':
+            mix = optarg;
+            break;
+        case 'k':
+            m_reconnect = strtoul(optarg, NULL, 0);
+            break;
+        case 'N':
+            m_nodelay = true;
+            break;
+        case 'B':
+            m_batch = true;
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    if (!m_connections || m_connections > MAX_CONNECTIONS) {
+        printf("1 to %u connections\n", MAX_CONNECTIONS);
+        return 1;
+    }
+    if (!parse_mix(mix)) {
+        return 1;
+    }
+
+    workers = calloc(m_connections, sizeof(*workers));
+    if (!workers) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    m_start = get_nsec();
+    for (started = 0; started < m_connections; started++) {
+        workers[started].id = started;
+        workers[started].seed = started + 1;
+        workers[started].sock = -1;
+        if (pthread_create(&workers[started].thread, NULL, worker_main,
+                           &workers[started])) {
+            printf("pthread_create failed\n");
+            m_stop = 1;
+            rc = 1;
+            break;
+        }
+    }
+
+    /* Wait for the duration, or for all workers to finish with '-n'. */
+    deadline = m_start + m_duration * 1000000000ULL;
+    while (!m_stop && get_nsec() < deadline &&
+           __atomic_load_n(&m_done, __ATOMIC_ACQUIRE) < started) {
+        usleep(WAIT_POLL_USEC);
+    }
+
+    /* Unblock workers still waiting on the proxy. */
+    m_stop = 1;
+    for (i = 0; i < started; i++) {
+        sock = __atomic_load_n(&workers[i].sock, __ATOMIC_ACQUIRE);
+        if (sock != -1) {
+            shutdown(sock, SHUT_RDWR);
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    if (!report(workers, (get_nsec() - m_start) / 1e9)) {
+        rc = 1;
+    }
+    free(workers);
+
+    return rc;
+}
+
+/* sim [-w file] [-d usec] [-g usec] [-s size] [-b blocks] */
+static int cmd_sim(int argc, char *argv[])
+{
+    psc_sim_t sim = {
+        .chain_size = 0xC00,
+        .num_meas = 10,
+    };
+    const char *path = PSC_SIM_WINDOW_PATH;
+    struct sigaction sa;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:d:g:s:b:")) != -1) {
+        switch (opt) {
+        case 'w':
+            path = optarg;
+            break;
+        case 'd':
+            sim.delay_usec = strtoul(optarg, NULL, 0);
+            break;
+        case 'g':
+            sim.sign_usec = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            sim.chain_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            sim.num_meas = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Simulated PSC on %s\n", path);
+    if (psc_sim_run(&sim, path, &m_stop)) {
+        return 1;
+    }
+    printf("%lu messages, %lu errors\n", sim.messages, sim.errors);
+
+    return 0;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s <command> [options]\n"
+           "  run            load spdm-proxy and report latency\n"
+           "    -a <addr>    proxy address, default " DEFAULT_ADDRESS "\n"
+           "    -p <port>    proxy port, default %u\n"
+           "    -c <n>       connections, default 1\n"
+           "    -t <sec>     duration, default %u\n"
+           "    -n <ops>     stop each connection after <ops> operations\n"
+           "    -r <rate>    total operations per second, default as fast as\n"
+           "                 possible\n"
+           "    -m <mix>     weighted operations, default " DEFAULT_MIX "\n"
+           "                 (vca, cert, meas, meas-idx)\n"
+           "    -k <ops>     reconnect after <ops> operations\n"
+           "    -N           disable Nagle\n"
+           "    -B           batch the certificate portions after the first\n"
+           "                 and the meas-idx requests\n"
+           "  sim            serve a simulated PSC for 'spdm-proxy -w'\n"
+           "    -w <file>    register window, default " PSC_SIM_WINDOW_PATH "\n"
+           "    -d <usec>    service time per message\n"
+           "    -g <usec>    extra service time per signature\n"
+           "    -s <size>    certificate chain size, default 3072\n"
+           "    -b <n>       measurement blocks, default 10\n",
+           prog, DEFAULT_SPDM_PLATFORM_PORT, DEFAULT_DURATION_SEC);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prog = argv[0], *cmd;
+
+    if (argc < 2 || !strcmp(argv[1], "-h")) {
+        usage(prog);
+        return argc < 2;
+    }
+
+    cmd = argv[1];
+    argc--;
+    argv++;
+
+    if (!strcmp(cmd, "run")) {
+        return cmd_run(argc, argv);
+    } else if (!strcmp(cmd, "sim")) {
+        return cmd_sim(argc, argv);
+    }
+
+    usage(prog);
+    return 1;
+}
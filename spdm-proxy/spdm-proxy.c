@@ -6,221 +6,122 @@
  * Copyright 2021-2022 DMTF. All rights reserved.
  */
 
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
 #include <error.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sched.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include "psc_mailbox.h"
+#include "spdm_platform.h"
 
-#define DEFAULT_SPDM_PLATFORM_PORT 2323
+/* Default busy-poll budget in low-latency mode. */
+#define DEFAULT_POLL_BUDGET_USEC 500
 
-#define SOCKET_SPDM_COMMAND_NORMAL 0x0001
-#define SOCKET_SPDM_COMMAND_OOB_ENCAP_KEY_UPDATE 0x8001
-#define SOCKET_SPDM_COMMAND_CONTINUE 0xFFFD
-#define SOCKET_SPDM_COMMAND_SHUTDOWN 0xFFFE
-#define SOCKET_SPDM_COMMAND_UNKOWN 0xFFFF
-#define SOCKET_SPDM_COMMAND_TEST 0xDEAD
+/* Stack pre-faulted in low-latency mode, covers platform_server() buffers. */
+#define PREFAULT_STACK_SIZE (256 * 1024)
 
-enum {
-    SOCKET_TRANSPORT_TYPE_NONE,    /* raw packet */
-    SOCKET_TRANSPORT_TYPE_MCTP,    /* MCTP payload */
-    SOCKET_TRANSPORT_TYPE_PCI_DOE  /* DOE payload */
-};
-
-uint32_t m_use_transport_layer = SOCKET_TRANSPORT_TYPE_MCTP;
+/*
+ * Default client idle timeout. A client holds the SPDM flow while connected,
+ * so keep it well below PSC_MAILBOX_FLOW_TIMEOUT_MSEC for local requesters.
+ */
+#define DEFAULT_IDLE_TIMEOUT_SEC 5
 
-/**
- * Read number of bytes data in blocking mode.
- *
- * If there is no enough data in socket, this function will wait.
- * This function will return if enough data is read, or socket error.
- **/
-bool read_bytes(const int socket, uint8_t *buffer,
-                uint32_t number_of_bytes)
-{
-    int32_t result;
-    uint32_t number_received;
-
-    number_received = 0;
-    while (number_received < number_of_bytes) {
-        result = recv(socket, (char *)(buffer + number_received),
-                      number_of_bytes - number_received, 0);
-        if (result == -1) {
-            printf("Receive error - %m\n");
-            return false;
-        }
-        if (result == 0) {
-            return false;
-        }
-        number_received += result;
-    }
-    return true;
-}
+/* Client idle timeout in seconds, 0 for none. */
+int m_idle_sec = DEFAULT_IDLE_TIMEOUT_SEC;
 
-bool read_data32(const int socket, uint32_t *data)
-{
-    bool result;
+/* Low-latency runtime options. */
+bool m_low_latency;
+int m_cpu = -1;
+int m_fifo_prio;
+int m_poll_usec = -1;
 
-    result = read_bytes(socket, (uint8_t *)data, sizeof(uint32_t));
-    if (!result) {
-        return result;
-    }
-    *data = ntohl(*data);
-    return true;
-}
+/* Register window of a simulated PSC instead of the hardware. */
+const char *m_window;
 
-/**
- * Read multiple bytes in blocking mode.
- *
- * The length is presented as first 4 bytes in big endian.
- * The data follows the length.
+/*
+ * Run the messages of a SOCKET_SPDM_COMMAND_BATCH frame back to back on the
+ * mailbox and send all the responses in one frame. The whole frame is
+ * checked before the first message goes out. A mailbox failure ends the
+ * batch early: the reply then carries the responses up to there.
  *
- * If there is no enough data in socket, this function will wait.
- * This function will return if enough data is read, or socket error.
- **/
-bool read_multiple_bytes(const int socket, uint8_t *buffer,
-                         uint32_t *bytes_received,
-                         uint32_t max_buffer_length)
+ * Returns false if the frame is malformed or the reply can't be sent.
+ */
+bool platform_batch(const int socket, const uint8_t *buffer, uint32_t size,
+                    uint16_t *context)
 {
-    uint32_t length;
-    bool result;
-
-    result = read_data32(socket, &length);
-    if (!result) {
-        return result;
-    }
-
-    *bytes_received = length;
-    if (*bytes_received > max_buffer_length) {
-        printf("buffer too small (0x%x). Expected - 0x%x\n",
-               max_buffer_length, *bytes_received);
+    static uint8_t rsp[SPDM_PLATFORM_MAX_BATCH][SPDM_PLATFORM_MAX_MSG_SIZE];
+    const uint8_t *req[SPDM_PLATFORM_MAX_BATCH];
+    uint32_t req_len[SPDM_PLATFORM_MAX_BATCH];
+    uint32_t lengths[1 + SPDM_PLATFORM_MAX_BATCH];
+    struct iovec iov[1 + 2 * SPDM_PLATFORM_MAX_BATCH];
+    uint32_t count, offset, rsp_size, i;
+
+    if (size < sizeof(count)) {
+        printf("malformed batch\n");
         return false;
     }
-    if (length == 0) {
-        return true;
-    }
-    result = read_bytes(socket, buffer, length);
-    if (!result) {
-        return result;
-    }
-
-    return true;
-}
-
-bool receive_platform_data(const int socket, uint32_t *command,
-                           uint8_t *buffer,
-                           uint32_t *size)
-{
-    bool result;
-    uint32_t response;
-    uint32_t transport_type;
-    uint32_t bytes_received;
-
-    result = read_data32(socket, &response);
-    if (!result) {
-        return result;
-    }
-    *command = response;
-
-    result = read_data32(socket, &transport_type);
-    if (!result) {
-        return result;
-    }
-    if (transport_type != m_use_transport_layer) {
-        printf("transport_type mismatch\n");
+    memcpy(&count, buffer, sizeof(count));
+    count = ntohl(count);
+    if (!count || count > SPDM_PLATFORM_MAX_BATCH) {
+        printf("invalid batch size %u\n", count);
         return false;
     }
 
-    bytes_received = 0;
-    result = read_multiple_bytes(socket, buffer, &bytes_received,
-                                 (uint32_t)*size);
-    if (!result) {
-        return result;
-    }
-    *size = bytes_received;
-
-    return result;
-}
-
-/**
- * Write number of bytes data in blocking mode.
- *
- * This function will return if data is written, or socket error.
- **/
-bool write_bytes(const int socket, const uint8_t *buffer,
-                 uint32_t number_of_bytes)
-{
-    int32_t result;
-    uint32_t number_sent;
-
-    number_sent = 0;
-    while (number_sent < number_of_bytes) {
-        result = send(socket, (char *)(buffer + number_sent),
-                      number_of_bytes - number_sent, 0);
-        if (result == -1) {
-            printf("Send error - %m\n");
+    offset = sizeof(count);
+    for (i = 0; i < count; i++) {
+        if (size - offset < sizeof(req_len[i])) {
+            printf("malformed batch\n");
             return false;
         }
-        number_sent += result;
-    }
-    return true;
-}
-
-bool write_data32(const int socket, uint32_t data)
-{
-    data = htonl(data);
-    return write_bytes(socket, (uint8_t *)&data, sizeof(uint32_t));
-}
-
-/**
- * Write multiple bytes.
- *
- * The length is presented as first 4 bytes in big endian.
- * The data follows the length.
- **/
-bool write_multiple_bytes(const int socket, const uint8_t *buffer,
-                          uint32_t bytes_to_send)
-{
-    bool result;
-
-    result = write_data32(socket, bytes_to_send);
-    if (!result) {
-        return result;
-    }
-
-    result = write_bytes(socket, buffer, bytes_to_send);
-    if (!result) {
-        return result;
+        memcpy(&req_len[i], buffer + offset, sizeof(req_len[i]));
+        req_len[i] = ntohl(req_len[i]);
+        offset += sizeof(req_len[i]);
+        if (!req_len[i] || req_len[i] > size - offset ||
+            req_len[i] > SPDM_PLATFORM_MAX_MSG_SIZE) {
+            printf("malformed batch\n");
+            return false;
+        }
+        req[i] = buffer + offset;
+        offset += req_len[i];
     }
-
-    return true;
-}
-
-bool send_platform_data(const int socket, uint32_t command,
-                        const uint8_t *buffer, uint32_t size)
-{
-    bool result;
-    uint32_t request;
-
-    request = command;
-    result = write_data32(socket, request);
-    if (!result) {
-        return result;
+    if (offset != size) {
+        printf("malformed batch\n");
+        return false;
     }
 
-    result = write_data32(socket, m_use_transport_layer);
-    if (!result) {
-        return result;
+    for (i = 0; i < count; i++) {
+        rsp_size = sizeof(rsp[i]);
+        if (!psc_mailbox_xfer(PSC_MBOX_SPDM_OPCODE, context, req[i],
+                              req_len[i], rsp[i], &rsp_size) || !rsp_size) {
+            printf("psc_mailbox_xfer failed, batch message %u of %u\n",
+                   i + 1, count);
+            break;
+        }
+        lengths[1 + i] = htonl(rsp_size);
+        iov[1 + 2 * i].iov_base = &lengths[1 + i];
+        iov[1 + 2 * i].iov_len = sizeof(lengths[1 + i]);
+        iov[2 + 2 * i].iov_base = rsp[i];
+        iov[2 + 2 * i].iov_len = rsp_size;
     }
+    lengths[0] = htonl(i);
+    iov[0].iov_base = &lengths[0];
+    iov[0].iov_len = sizeof(lengths[0]);
 
-    result = write_multiple_bytes(socket, buffer, size);
-    if (!result) {
-        return result;
+    if (!send_platform_data_vec(socket, SOCKET_SPDM_COMMAND_BATCH, iov,
+                                1 + 2 * i)) {
+        printf("send_platform_data Error - %m\n");
+        return false;
     }
 
     return true;
@@ -228,8 +129,8 @@ bool send_platform_data(const int socket, uint32_t command,
 
 bool platform_server(const int socket)
 {
-    uint8_t buffer[0x1200 + 64];
-    uint32_t command, size;
+    uint8_t buffer[SPDM_PLATFORM_MAX_BATCH_SIZE];
+    uint32_t command, size, rsp_size;
     uint16_t context = 0;
     bool result;
 
@@ -238,8 +139,12 @@ bool platform_server(const int socket)
         result = receive_platform_data(socket, &command,
                            buffer,
                            &size);
-        if (!result || size > sizeof(buffer))
-            continue;
+        if (!result || size > sizeof(buffer)) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                printf("Client idle for %d s, disconnecting\n", m_idle_sec);
+            }
+            return true;
+        }
 
         switch (command) {
         case SOCKET_SPDM_COMMAND_TEST:
@@ -283,19 +188,18 @@ bool platform_server(const int socket)
             return true;
 
         case SOCKET_SPDM_COMMAND_NORMAL:
-            result = psc_mailbox_send_msg(PSC_MBOX_SPDM_OPCODE, context, buffer,
-                                          size);
-            if (!result) {
-                printf("psc_mailbox_send_msg failed\n");
+            if (size > SPDM_PLATFORM_MAX_MSG_SIZE) {
+                printf("message too large (0x%x)\n", size);
                 return true;
             }
-            size = sizeof(buffer);
-            result = psc_mailbox_recv_msg(PSC_MBOX_SPDM_OPCODE, &context, buffer,
-                                          &size);
-            if (!result || !size) {
-                printf("psc_mailbox_recv_msg failed\n");
+            rsp_size = SPDM_PLATFORM_MAX_MSG_SIZE;
+            result = psc_mailbox_xfer(PSC_MBOX_SPDM_OPCODE, &context, buffer,
+                                      size, buffer, &rsp_size);
+            if (!result || !rsp_size) {
+                printf("psc_mailbox_xfer failed\n");
                 return true;
             }
+            size = rsp_size;
             result = send_platform_data(
                 socket, SOCKET_SPDM_COMMAND_NORMAL, buffer, size);
             if (!result) {
@@ -303,6 +207,12 @@ bool platform_server(const int socket)
             }
             break;
 
+        case SOCKET_SPDM_COMMAND_BATCH:
+            if (!platform_batch(socket, buffer, size, &context)) {
+                return true;
+            }
+            break;
+
         default:
             printf("Unrecognized platform interface command %x\n",
                    command);
@@ -364,6 +274,7 @@ bool platform_server_routine(uint16_t port_number)
 {
     int listen_socket, server_socket;
     struct sockaddr_in peer_address;
+    struct timeval tv;
     bool result;
     uint32_t length;
     bool continue_serving;
@@ -388,7 +299,36 @@ bool platform_server_routine(uint16_t port_number)
         }
         printf("Client accepted\n");
 
+        if (m_low_latency) {
+            setsockopt(server_socket, IPPROTO_TCP, TCP_NODELAY, &(int){1},
+                       sizeof(int));
+        }
+        if (m_poll_usec > 0) {
+            /* Needs CAP_NET_ADMIN beyond net.core.busy_read; best effort. */
+            setsockopt(server_socket, SOL_SOCKET, SO_BUSY_POLL, &m_poll_usec,
+                       sizeof(m_poll_usec));
+        }
+
+        /*
+         * The client runs its own SPDM flow through us, keep local
+         * requesters from resetting it until it disconnects, or goes idle
+         * and is dropped so that a stuck client can't hold the flow.
+         */
+        if (m_idle_sec > 0) {
+            tv.tv_sec = m_idle_sec;
+            tv.tv_usec = 0;
+            setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, &tv,
+                       sizeof(tv));
+            setsockopt(server_socket, SOL_SOCKET, SO_SNDTIMEO, &tv,
+                       sizeof(tv));
+        }
+        if (psc_mailbox_flow_lock(PSC_MAILBOX_FLOW_TIMEOUT_MSEC)) {
+            close(server_socket);
+            continue_serving = true;
+            continue;
+        }
         continue_serving = platform_server(server_socket);
+        psc_mailbox_flow_unlock();
         close(server_socket);
     } while (continue_serving);
 
@@ -396,16 +336,120 @@ bool platform_server_routine(uint16_t port_number)
     return true;
 }
 
+/* Touch the stack so that it's resident before serving requests. */
+void prefault_stack(void)
+{
+    volatile uint8_t stack[PREFAULT_STACK_SIZE];
+    uint32_t i;
+
+    for (i = 0; i < sizeof(stack); i += 4096) {
+        stack[i] = 0;
+    }
+}
+
+/**
+ * Set up the low-latency runtime.
+ *
+ * The proxy services the mailbox from its only thread, so pinning, priority
+ * and memory locking apply to the whole process. Busy-polling is bounded by
+ * the poll budget to avoid starving the pinned core under SCHED_FIFO.
+ **/
+bool setup_low_latency(void)
+{
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    if (m_cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+            printf("Cannot pin to CPU %d - %m\n", m_cpu);
+            return false;
+        }
+    }
+
+    if (m_low_latency) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+            printf("Cannot lock memory - %m\n");
+            return false;
+        }
+        prefault_stack();
+
+        if (m_poll_usec < 0) {
+            m_poll_usec = DEFAULT_POLL_BUDGET_USEC;
+        }
+    }
+
+    if (m_poll_usec > 0) {
+        psc_mailbox_set_poll_budget(m_poll_usec);
+    }
+
+    if (m_fifo_prio) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = m_fifo_prio;
+        if (sched_setscheduler(0, SCHED_FIFO, &param)) {
+            printf("Cannot set SCHED_FIFO priority %d - %m\n", m_fifo_prio);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+           "  -L         low-latency mode: lock and pre-fault memory, disable\n"
+           "             Nagle, busy-poll for %d us by default\n"
+           "  -c <cpu>   pin the proxy to <cpu>\n"
+           "  -f <prio>  run with SCHED_FIFO priority <prio>\n"
+           "  -b <usec>  busy-poll budget before sleeping, 0 to disable\n"
+           "  -w <file>  use the mailbox register window of a simulated PSC\n"
+           "  -i <sec>   drop clients idle for <sec>, default %d, 0 never\n",
+           prog, DEFAULT_POLL_BUDGET_USEC, DEFAULT_IDLE_TIMEOUT_SEC);
+}
+
 int main(int argc, char *argv[])
 {
-    int rc;
+    int rc, opt;
 
-    rc = psc_mailbox_init();
+    while ((opt = getopt(argc, argv, "Lc:f:b:w:i:h")) != -1) {
+        switch (opt) {
+        case 'L':
+            m_low_latency = true;
+            break;
+        case 'c':
+            m_cpu = atoi(optarg);
+            break;
+        case 'f':
+            m_fifo_prio = atoi(optarg);
+            break;
+        case 'b':
+            m_poll_usec = atoi(optarg);
+            break;
+        case 'w':
+            m_window = optarg;
+            break;
+        case 'i':
+            m_idle_sec = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    rc = m_window ? psc_mailbox_init_window(m_window) : psc_mailbox_init();
     if (rc) {
         printf("Fail to start spdm-proxy\n");
         return rc;
     }
 
+    if (!setup_low_latency()) {
+        printf("Fail to start spdm-proxy\n");
+        return 1;
+    }
+
     platform_server_routine(DEFAULT_SPDM_PLATFORM_PORT);
 
     return 0;
@@ -0,0 +1,429 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/* Attestation snapshot service and reader.
+ *
+ * "serve" owns the PSC mailbox side: it fetches the certificate chain and
+ * signed measurements on a schedule or when a reader asks, verifies them
+ * and publishes the result in shared memory (see spdm_snapshot.h). "get"
+ * and "status" are readers: they never touch the mailbox.
+ *
+ * Copyright (C) 2023 NVIDIA CORPORATION.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "psc_mailbox.h"
+#include "spdm_meas.h"
+#include "spdm_req.h"
+#include "spdm_snapshot.h"
+#include "spdm_verify.h"
+
+#define DEFAULT_INTERVAL_SEC    60U
+#define REQUEST_TIMEOUT_MSEC    10000U
+
+static volatile sig_atomic_t m_exit;
+static spdm_req_t m_req;
+static spdm_snapshot_t m_snap;
+
+static uint8_t *read_file(const char *path, size_t *len)
+{
+    uint8_t *buf;
+    long size;
+    FILE *fp;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buf = malloc(size ? size : 1);
+    if (buf && fread(buf, 1, size, fp) != (size_t)size) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+
+    *len = size;
+    return buf;
+}
+
+static bool write_file(const char *dir, const char *name, const uint8_t *buf,
+                       size_t len)
+{
+    char path[PATH_MAX];
+    bool result;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    fp = fopen(path, "wb");
+    if (!fp) {
+        printf("%s: %m\n", path);
+        return false;
+    }
+    result = fwrite(buf, 1, len, fp) == len;
+    result = !fclose(fp) && result;
+    if (!result) {
+        printf("%s: %m\n", path);
+        return false;
+    }
+
+    printf("write file - %s\n", path);
+    return true;
+}
+
+static const char *format_time(uint64_t ns, char *buf, size_t size)
+{
+    time_t t = ns / 1000000000ULL;
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    return buf;
+}
+
+static void handle_exit(int sig)
+{
+    m_exit = 1;
+}
+
+/* Collect, verify and fill m_snap. */
+static bool collect(spdm_cert_cache_t *cache, uint8_t slot)
+{
+    spdm_snapshot_t *snap = &m_snap;
+    spdm_pubkey_t *key = NULL;
+    spdm_meas_rsp_t rsp;
+    spdm_evidence_t ev;
+    struct timespec ts;
+    uint32_t hash_size;
+    bool result = false;
+    int status;
+
+    if (spdm_req_connect(&m_req) ||
+        spdm_req_get_certificate(&m_req, slot, snap->chain,
+                                 &snap->chain_len)) {
+        return false;
+    }
+
+    snap->slot = slot;
+    hash_size = spdm_hash_size(m_req.base_hash_algo);
+    status = spdm_chain_verify(cache, snap->chain, snap->chain_len,
+                               hash_size, &key);
+    if (status != SPDM_CHAIN_OK) {
+        printf("certificate chain: %s\n", spdm_chain_strerror(status));
+        return false;
+    }
+    snap->flags = SPDM_SNAPSHOT_CHAIN_TRUSTED;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (spdm_req_get_measurements(&m_req, SPDM_MEAS_ATTR_SIGNATURE |
+                                  SPDM_MEAS_ATTR_RAW_BIT_STREAM,
+                                  SPDM_MEAS_OP_ALL, slot, &rsp)) {
+        goto out;
+    }
+    if (!spdm_verify_meas_signature(key, m_req.version, m_req.base_hash_algo,
+                                    m_req.base_asym_algo, rsp.transcript,
+                                    rsp.transcript_len, rsp.signature,
+                                    rsp.signature_len)) {
+        printf("verify_measurement_signature - FAIL\n");
+        goto out;
+    }
+
+    if (rsp.record_len > sizeof(snap->record)) {
+        printf("measurement record too large\n");
+        goto out;
+    }
+    memcpy(snap->record, rsp.record, rsp.record_len);
+    snap->record_len = rsp.record_len;
+
+    ev.version = m_req.version;
+    ev.slot = slot;
+    ev.meas_hash_algo = m_req.meas_hash_algo;
+    ev.base_hash_algo = m_req.base_hash_algo;
+    ev.base_asym_algo = m_req.base_asym_algo;
+    ev.transcript = rsp.transcript;
+    ev.transcript_len = rsp.transcript_len;
+    ev.record = rsp.transcript + rsp.record_offset;
+    ev.record_len = rsp.record_len;
+    ev.signature = rsp.signature;
+    ev.signature_len = rsp.signature_len;
+    snap->evidence_len = spdm_evidence_encode(&ev, snap->evidence,
+                                              sizeof(snap->evidence));
+    if (!snap->evidence_len) {
+        printf("evidence too large\n");
+        goto out;
+    }
+
+    snap->time = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    result = true;
+
+out:
+    spdm_pubkey_free(key);
+    return result;
+}
+
+/* Collect, verify and fill m_snap, owning the SPDM flow throughout. */
+static bool refresh(spdm_cert_cache_t *cache, uint8_t slot)
+{
+    bool result;
+
+    if (psc_mailbox_flow_lock(PSC_MAILBOX_FLOW_TIMEOUT_MSEC)) {
+        return false;
+    }
+    result = collect(cache, slot);
+    psc_mailbox_flow_unlock();
+
+    return result;
+}
+
+/*
+ * serve -r root.der [-r ...] [-s slot] [-i interval]
+ *
+ * Only snapshots whose chain leads to a root are published. Failed
+ * refreshes are retried sooner than the interval, backing off.
+ */
+static int cmd_serve(int argc, char *argv[])
+{
+    uint32_t interval = DEFAULT_INTERVAL_SEC, retry, seen;
+    spdm_cert_cache_t *cache = NULL;
+    spdm_snapshot_map_t map;
+    struct sigaction sa;
+    uint8_t slot = 0, *der;
+    size_t der_len;
+    char buf[32];
+    int opt, rc = 1;
+
+    while ((opt = getopt(argc, argv, "r:s:i:")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (!cache && !(cache = spdm_cert_cache_new())) {
+                printf("out of memory\n");
+                goto out;
+            }
+            der = read_file(optarg, &der_len);
+            if (!der) {
+                printf("%s: %m\n", optarg);
+                goto out;
+            }
+            if (!spdm_cert_cache_add_root(cache, der, der_len)) {
+                free(der);
+                goto out;
+            }
+            free(der);
+            break;
+        case 's':
+            slot = atoi(optarg) & 0xF;
+            break;
+        case 'i':
+            interval = strtoul(optarg, NULL, 0);
+            if (!interval) {
+                interval = 1;
+            }
+            break;
+        default:
+            goto out;
+        }
+    }
+    if (!cache) {
+        printf("a trusted root is required (-r)\n");
+        goto out;
+    }
+
+    if (psc_mailbox_init()) {
+        printf("Fail to init PSC mailbox\n");
+        goto out;
+    }
+    if (spdm_snapshot_create(&map)) {
+        goto out;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_exit;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    seen = __atomic_load_n(&map.region->request, __ATOMIC_ACQUIRE);
+    retry = 1;
+    while (!m_exit) {
+        if (refresh(cache, slot)) {
+            spdm_snapshot_publish(&map, &m_snap);
+            printf("%s snapshot %u: %u bytes of measurements\n",
+                   format_time(m_snap.time, buf, sizeof(buf)),
+                   m_snap.generation, m_snap.record_len);
+            retry = 1;
+            spdm_snapshot_wait_request(&map, &seen, interval * 1000U);
+        } else {
+            spdm_snapshot_fail(&map);
+            printf("refresh failed, retry in %u s\n",
+                   retry < interval ? retry : interval);
+            spdm_snapshot_wait_request(&map, &seen,
+                                       (retry < interval ? retry :
+                                        interval) * 1000U);
+            if (retry < interval) {
+                retry *= 2;
+            }
+        }
+    }
+    rc = 0;
+
+    spdm_snapshot_close(&map);
+out:
+    spdm_cert_cache_free(cache);
+    return rc;
+}
+
+/*
+ * get [-R] [-d dir]
+ *
+ * -R asks the service for a fresh snapshot first. With -d, the snapshot
+ * is saved as spdm_requester_emu / spdm-meas-sync would, so it can be fed
+ * to the other tools.
+ */
+static int cmd_get(int argc, char *argv[])
+{
+    static spdm_meas_block_t blocks[256];
+    spdm_snapshot_map_t map;
+    uint32_t generation, waited = 0;
+    const char *dir = NULL;
+    bool refresh = false;
+    char name[64], buf[32];
+    int opt, rc = 1, n;
+
+    while ((opt = getopt(argc, argv, "Rd:")) != -1) {
+        switch (opt) {
+        case 'R':
+            refresh = true;
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            return 1;
+        }
+    }
+
+    if (spdm_snapshot_open(&map)) {
+        return 1;
+    }
+
+    if (refresh) {
+        generation = spdm_snapshot_generation(&map);
+        if (spdm_snapshot_request(&map)) {
+            printf("no permission to request a refresh\n");
+            goto out;
+        }
+        while (spdm_snapshot_generation(&map) == generation) {
+            if (waited >= REQUEST_TIMEOUT_MSEC) {
+                printf("no fresh snapshot after %u ms\n", waited);
+                goto out;
+            }
+            usleep(1000);
+            waited++;
+        }
+    }
+
+    if (spdm_snapshot_read(&map, &m_snap)) {
+        if (errno == ENODATA) {
+            printf("no snapshot yet\n");
+        } else if (errno == EOWNERDEAD) {
+            printf("service died while publishing, no snapshot\n");
+        } else {
+            printf("snapshot still being written after %u ms\n",
+                   SPDM_SNAPSHOT_READ_TIMEOUT_MSEC);
+        }
+        goto out;
+    }
+
+    n = spdm_meas_index(m_snap.record, m_snap.record_len, blocks);
+    printf("snapshot %u: %s, slot %u, %d measurement blocks, chain %s\n",
+           m_snap.generation, format_time(m_snap.time, buf, sizeof(buf)),
+           m_snap.slot, n, m_snap.flags & SPDM_SNAPSHOT_CHAIN_TRUSTED ?
+           "trusted" : "not checked");
+
+    if (dir) {
+        snprintf(name, sizeof(name), "device_cert_chain_%u.bin",
+                 m_snap.slot);
+        if (!write_file(dir, "device_measurement.bin", m_snap.record,
+                        m_snap.record_len) ||
+            !write_file(dir, name, m_snap.chain, m_snap.chain_len) ||
+            !write_file(dir, "device_measurement_sig.bin", m_snap.evidence,
+                        m_snap.evidence_len)) {
+            goto out;
+        }
+    }
+    rc = 0;
+
+out:
+    spdm_snapshot_close(&map);
+    return rc;
+}
+
+static int cmd_status(int argc, char *argv[])
+{
+    spdm_snapshot_map_t map;
+    char buf[32];
+
+    if (spdm_snapshot_open(&map)) {
+        return 1;
+    }
+
+    printf("pid %d%s, generation %u, last attempt %s, %u failures\n",
+           map.region->pid,
+           spdm_snapshot_service_alive(&map) ? "" : " (not running)",
+           spdm_snapshot_generation(&map),
+           format_time(map.region->last_attempt, buf, sizeof(buf)),
+           map.region->failures);
+
+    spdm_snapshot_close(&map);
+    return 0;
+}
+
+void usage(const char *prog)
+{
+    printf("Usage: %s <command> [options]\n"
+           "  serve -r <root.der> [-r ...] [-s <slot>] [-i <seconds>]\n"
+           "                 collect and publish snapshots, every 60 s by\n"
+           "                 default; chains must lead to one of the roots\n"
+           "  get [-R] [-d <dir>]\n"
+           "                 show the current snapshot, '-R' refreshes it\n"
+           "                 first, '-d' saves it as dump files\n"
+           "  status         show the service status\n",
+           prog);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *prog = argv[0], *cmd;
+
+    if (argc < 2 || !strcmp(argv[1], "-h")) {
+        usage(argv[0]);
+        return argc < 2;
+    }
+
+    cmd = argv[1];
+    argc--;
+    argv++;
+
+    if (!strcmp(cmd, "serve")) {
+        return cmd_serve(argc, argv);
+    } else if (!strcmp(cmd, "get")) {
+        return cmd_get(argc, argv);
+    } else if (!strcmp(cmd, "status")) {
+        return cmd_status(argc, argv);
+    }
+
+    usage(prog);
+    return 1;
+}